@@ -0,0 +1,343 @@
+#!/usr/bin/env python3
+"""
+Benchmark for the buzzer analyzer on synthetic calibration sweeps
+Generates sweeps from the firmware constants in main.c (intro beeps, tone
+and pause lengths, frequency range) through a simulated piezo, runs them
+through every analysis engine and compares against stored baselines.
+
+Usage:
+    python bench_analyzer.py                    # All engines, all scenarios
+    python bench_analyzer.py --engines track    # One engine
+    python bench_analyzer.py --update-baseline  # Accept current numbers
+"""
+
+import argparse
+import contextlib
+import io
+import json
+import re
+import sys
+import time
+import tracemalloc
+from pathlib import Path
+
+import numpy as np
+
+import buzzer_analyzer as ba
+
+FIRMWARE = Path(__file__).with_name("main.c")
+BASELINE = Path(__file__).with_name("bench_baseline.json")
+
+# Synthetic signal
+LEAD_IN_S = 1.5           # Silence before the intro (noise learning for --denoise)
+MIC_LEVEL_DB = -8         # Square wave fundamental at the loudest mode (dBFS; ~-20 dB on the analyzer scale)
+MODE_Q = 60               # Q of the simulated piezo modes (ba.PIEZO_MODES)
+NOISE_START_DB = -16      # 'noise': white noise ramps from this level (dBFS RMS)...
+NOISE_END_DB = 0          # ... to this one (a motor spinning up; later tones sink under it)
+HUM_HZ = 120              # Motor/mains hum in the 'noise' scenario
+LOCK_RANGE_HZ = 45        # 'mode_locking': tones this close to a mode get pulled
+LOCK_PULL = 0.6           # ... this fraction of the way onto it
+
+# Scoring and regression limits
+MATCH_TOL_HZ = 25         # A mapped tone counts as correct within this of the emitted frequency
+FREQ_ERR_SLACK_HZ = 0.5   # Allowed increase of the mean frequency error over baseline
+SPEED_TOLERANCE = 0.5     # Warn below this fraction of the baseline speed relative to argmax
+MEMORY_TOLERANCE = 1.5    # Warn above this multiple of the baseline peak memory
+NATIVE_TOLERANCE = 1e-6   # Max native vs NumPy difference in detected Hz / dB
+
+SCENARIOS = {
+    'clean': {},
+    'noise': {'noise': True},
+    'harmonics': {'harmonics': True},
+    'mode_locking': {'locking': True},
+    'dropped': {'drop': 1},
+    'combined': {'noise': True, 'harmonics': True, 'locking': True, 'drop': 1},
+}
+
+# Analysis engines: SpectrumAnalyzer options, or 'phyphox' for analyze_spectrum.py's
+# time-slot mapping of a peak history (needs pandas/matplotlib, skipped without).
+# 'native' runs the dsp_core.c kernels (make dsp) and is checked against NumPy.
+ENGINES = {
+    'argmax': {'engine': 'numpy'},
+    'track': {'engine': 'numpy', 'track': True},
+    'denoise': {'engine': 'numpy', 'denoise': True},
+    'native': {'engine': 'native'},
+    'phyphox': 'phyphox',
+}
+
+
+def firmware_constants(path=FIRMWARE):
+    """Numeric #defines from the firmware source"""
+    text = Path(path).read_text()
+    return {name: int(value) for name, value in re.findall(r'#define\s+(\w+)\s+(\d+)\b', text)}
+
+
+def piezo_gain(freq):
+    """Relative amplitude of the simulated piezo: Lorentzian modes at PIEZO_MODES"""
+    gains = [0.5, 1.0, 0.6, 0.8, 0.4, 0.5]  # Mode #2 loudest, as measured (PIEZO_RESEARCH.md)
+    return sum(g / np.sqrt(1 + (2 * MODE_Q * (freq - m) / m) ** 2)
+               for g, m in zip(gains, ba.PIEZO_MODES))
+
+
+def synth_sweep(fw, scenario, rate=ba.SAMPLE_RATE, seed=1):
+    """Synthetic recording of one calibration sweep, as auto_sweep_mode() plays it.
+
+    Returns (samples, truth): truth lists every sweep tone with its
+    nominal and emitted frequency and whether it was dropped.
+    """
+    rng = np.random.default_rng(seed)
+    sweep = list(range(fw['FREQ_MIN'], fw['FREQ_MAX'] + 1, fw['FREQ_STEP']))
+    dropped = set(rng.choice(np.arange(1, len(sweep) - 1), scenario.get('drop', 0), replace=False))
+    level = 10 ** (MIC_LEVEL_DB / 20) / max(piezo_gain(f) for f in np.arange(fw['FREQ_MIN'], fw['FREQ_MAX'], 1.0))
+
+    def tone(freq, ms):
+        t = np.arange(int(rate * ms / 1000)) / rate
+        # Software PWM square wave; 'harmonics' adds an asymmetric duty cycle (even harmonics)
+        duty = 0.35 if scenario.get('harmonics') else 0.5
+        phase = (freq * t) % 1.0
+        wave = np.where(phase < duty, 1.0, -1.0) - (2 * duty - 1)
+        return level * piezo_gain(freq) * wave * (np.pi / 4)
+
+    def silence(ms):
+        return np.zeros(int(rate * ms / 1000))
+
+    parts = [silence(LEAD_IN_S * 1000),
+             tone(fw['DEFAULT_FREQ'], fw['BEEP_LONG_MS']), silence(fw['PAUSE_LONG_MS']),
+             tone(fw['DEFAULT_FREQ'], fw['BEEP_LONG_MS']), silence(500)]
+    sweep_start = sum(len(p) for p in parts) / rate
+    truth = []
+    for i, freq in enumerate(sweep):
+        emitted = float(freq)
+        if scenario.get('locking'):
+            mode = min(ba.PIEZO_MODES, key=lambda m: abs(m - freq))
+            if abs(mode - freq) < LOCK_RANGE_HZ:
+                emitted += LOCK_PULL * (mode - freq)
+        truth.append({'freq': freq, 'emitted': emitted, 'dropped': i in dropped,
+                      'gain': piezo_gain(emitted), 'start': sweep_start})
+        parts.append(silence(fw['CALIB_TONE_MS']) if i in dropped else tone(emitted, fw['CALIB_TONE_MS']))
+        parts.append(silence(fw['CALIB_PAUSE_MS']))
+    parts.append(silence(1000))
+
+    samples = np.concatenate(parts)
+    if scenario.get('noise'):
+        t = np.arange(len(samples)) / rate
+        level_db = np.linspace(NOISE_START_DB, NOISE_END_DB, len(samples))
+        samples += 10 ** (level_db / 20) * rng.standard_normal(len(samples))
+        samples += 0.05 * np.sign(np.sin(2 * np.pi * HUM_HZ * t))
+    return samples.astype(np.float32), truth
+
+
+def run_engine(options, samples, rate, sweep_start=0.0):
+    """Run one engine over the samples; returns (results, blocks)"""
+    analyzer = ba.SpectrumAnalyzer(sample_rate=rate, **(options if isinstance(options, dict) else {}))
+    analyzer.start_recording()
+    block = analyzer.block_size
+    n = len(samples) // block
+    for i in range(n):
+        analyzer.process_audio(samples[i * block:(i + 1) * block], timestamp=(i + 1) * block / rate)
+    peaks = analyzer.stop_recording()
+    if options == 'phyphox':
+        return phyphox_sweep(peaks, sweep_start), n
+    with contextlib.redirect_stdout(io.StringIO()):
+        results = ba.analyze_sweep(peaks, native=analyzer.native)  # Tone segmentation follows the engine
+    return results or [], n
+
+
+def phyphox_sweep(peaks, sweep_start):
+    """analyze_spectrum.analyze_sweep() on the per-block peak history.
+
+    Its fixed time slots need the sweep start, which an export trimmed by
+    hand would provide; here it comes from the synthetic truth. There are
+    no levels, so it can't pick a best frequency.
+    """
+    import pandas as pd
+    import analyze_spectrum
+    history = pd.DataFrame({'time': [p[0] - sweep_start for p in peaks],
+                            'peak_freq': [float(p[1]) for p in peaks]})
+    df = analyze_spectrum.analyze_sweep(history, freq_min=ba.FREQ_MIN, freq_max=ba.FREQ_MAX,
+                                        freq_step=ba.FREQ_STEP)
+    return [{'expected_freq': int(row.expected_freq), 'detected_freq': row.avg_detected}
+            for row in df.itertuples()]
+
+
+def engine_available(engine):
+    options = ENGINES[engine]
+    if options == 'phyphox':
+        try:
+            import analyze_spectrum  # noqa: F401 (pandas, matplotlib)
+            return True
+        except ImportError:
+            return False
+    return options.get('engine') != 'native' or ba.NativeDSP.load() is not None
+
+
+def reference_diff(results, options, samples, sweep_start):
+    """Largest difference in detected Hz / max dB from the NumPy path with the same options"""
+    reference, _ = run_engine(dict(options, engine='numpy'), samples, ba.SAMPLE_RATE, sweep_start)
+    if len(reference) != len(results):
+        return float('inf')
+    return max([max(abs(a['detected_freq'] - b['detected_freq']), abs(a['max_db'] - b['max_db']))
+                for a, b in zip(results, reference)] or [0.0])
+
+
+def score(results, truth):
+    """Detection accuracy, best-frequency hit and mean frequency error against the truth"""
+    played = {t['freq']: t for t in truth if not t['dropped']}
+    if len(played) < len(truth):
+        # analyze_sweep labels tones by order, so after a gap every label shifts:
+        # match each played tone to whichever result was detected at its frequency
+        def hit(t):
+            return min(results, key=lambda r: abs(r['detected_freq'] - t['emitted']), default=None)
+    else:
+        by_freq = {r['expected_freq']: r for r in results}
+
+        def hit(t):
+            return by_freq.get(t['freq'])
+    errors = [abs(r['detected_freq'] - t['emitted']) for t in played.values() if (r := hit(t))]
+    errors = [e for e in errors if e <= MATCH_TOL_HZ]
+    best = max(played.values(), key=lambda t: t['gain'])
+    if results and 'max_db' not in results[0]:
+        best_ok = None  # Engine reports no levels
+    else:
+        best_ok = bool(results) and max(results, key=lambda r: r['max_db']) is hit(best)
+    return {'accuracy': len(errors) / len(played), 'best_ok': best_ok,
+            'freq_err_hz': float(np.mean(errors)) if errors else None}
+
+
+def bench(engine, scenario_name, fw, repeat, seed):
+    """Accuracy, speed and memory of one engine on one scenario"""
+    samples, truth = synth_sweep(fw, SCENARIOS[scenario_name], seed=seed)
+    options = ENGINES[engine]
+
+    best_s = np.inf
+    for _ in range(repeat):
+        t0 = time.perf_counter()
+        results, blocks = run_engine(options, samples, ba.SAMPLE_RATE, truth[0]['start'])
+        best_s = min(best_s, time.perf_counter() - t0)
+
+    # Separate run: tracemalloc slows the allocation-heavy path down
+    tracemalloc.start()
+    run_engine(options, samples, ba.SAMPLE_RATE, truth[0]['start'])
+    peak = tracemalloc.get_traced_memory()[1]
+    tracemalloc.stop()
+
+    metrics = score(results, truth)
+    metrics.update(blocks=blocks, blocks_per_s=blocks / best_s, peak_mb=peak / 2**20)
+    if isinstance(options, dict) and options.get('engine') == 'native':
+        metrics['reference_diff'] = reference_diff(results, options, samples, truth[0]['start'])
+    return metrics
+
+
+def compare(current, baseline):
+    """Regressions (accuracy, frequency error) and warnings (speed, memory) vs the baseline"""
+    regressions, warnings = [], []
+    for engine, scenarios in current.items():
+        for name, m in scenarios.items():
+            tag = f"{engine}/{name}"
+            if m.get('reference_diff', 0.0) > NATIVE_TOLERANCE:
+                regressions.append(f"{tag}: differs from the NumPy path by {m['reference_diff']:.3g}")
+            base = baseline.get(engine, {}).get(name)
+            if not base:
+                continue
+            if m['accuracy'] < base['accuracy']:
+                regressions.append(f"{tag}: accuracy {m['accuracy']:.0%} < {base['accuracy']:.0%}")
+            if base['best_ok'] and m['best_ok'] is False:
+                regressions.append(f"{tag}: best frequency no longer found")
+            if base['freq_err_hz'] is not None and m['freq_err_hz'] is not None \
+                    and m['freq_err_hz'] > base['freq_err_hz'] + FREQ_ERR_SLACK_HZ:
+                regressions.append(f"{tag}: frequency error {m['freq_err_hz']:.2f} Hz "
+                                   f"> {base['freq_err_hz']:.2f} Hz")
+            # Blocks/s depend on the machine: compare each engine's speed relative to
+            # argmax on the same scenario, in this run and in the baseline
+            ref = current.get('argmax', {}).get(name)
+            base_ref = baseline.get('argmax', {}).get(name)
+            if engine != 'argmax' and ref and base_ref:
+                rel = m['blocks_per_s'] / ref['blocks_per_s']
+                base_rel = base['blocks_per_s'] / base_ref['blocks_per_s']
+                if rel < SPEED_TOLERANCE * base_rel:
+                    warnings.append(f"{tag}: {rel:.2f}× the blocks/s of argmax vs {base_rel:.2f}×")
+            if m['peak_mb'] > MEMORY_TOLERANCE * base['peak_mb']:
+                warnings.append(f"{tag}: peak memory {m['peak_mb']:.1f} MB vs {base['peak_mb']:.1f} MB")
+    return regressions, warnings
+
+
+def print_table(current):
+    print(f"\n  {'Engine':<9} {'Scenario':<13} {'Accuracy':>8} {'Best':>5} {'Err Hz':>7} "
+          f"{'Blocks/s':>9} {'Peak MB':>8}")
+    print("  " + "-" * 64)
+    for engine, scenarios in current.items():
+        for name, m in scenarios.items():
+            err = f"{m['freq_err_hz']:.2f}" if m['freq_err_hz'] is not None else "-"
+            best = {True: '✓', False: '✗', None: '-'}[m['best_ok']]
+            print(f"  {engine:<9} {name:<13} {m['accuracy']:>8.0%} {best:>5} "
+                  f"{err:>7} {m['blocks_per_s']:>9.0f} {m['peak_mb']:>8.1f}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark analysis engines on synthetic buzzer sweeps")
+    parser.add_argument('--engines', default=','.join(ENGINES),
+                        help=f"Comma-separated engines (default: {','.join(ENGINES)})")
+    parser.add_argument('--scenarios', default=','.join(SCENARIOS),
+                        help=f"Comma-separated scenarios (default: {','.join(SCENARIOS)})")
+    parser.add_argument('--repeat', type=int, default=5, help='Timing runs per case, best is kept (default: 5)')
+    parser.add_argument('--seed', type=int, default=1, help='Noise/dropped-tone seed (default: 1)')
+    parser.add_argument('--baseline', default=str(BASELINE), help='Baseline JSON file')
+    parser.add_argument('--update-baseline', action='store_true', help='Store these results as the new baseline')
+    args = parser.parse_args()
+
+    engines = [e for e in args.engines.split(',') if e]
+    scenarios = [s for s in args.scenarios.split(',') if s]
+    for name in engines:
+        if name not in ENGINES:
+            print(f"❌ Unknown engine {name} (have: {', '.join(ENGINES)})")
+            return 1
+    for name in scenarios:
+        if name not in SCENARIOS:
+            print(f"❌ Unknown scenario {name} (have: {', '.join(SCENARIOS)})")
+            return 1
+
+    for name in [e for e in engines if not engine_available(e)]:
+        need = "'make dsp'" if name == 'native' else "pandas and matplotlib for analyze_spectrum.py"
+        print(f"⚠ Skipping engine {name}: needs {need}")
+        engines.remove(name)
+
+    fw = firmware_constants()
+    sweep_len = (fw['FREQ_MAX'] - fw['FREQ_MIN']) // fw['FREQ_STEP'] + 1
+    print(f"\n🧪 Analyzer benchmark: {sweep_len}-tone sweep {fw['FREQ_MIN']}-{fw['FREQ_MAX']} Hz "
+          f"({fw['CALIB_TONE_MS']}/{fw['CALIB_PAUSE_MS']} ms) from {FIRMWARE.name}")
+
+    current = {}
+    for engine in engines:
+        for name in scenarios:
+            print(f"\r  ⏳ {engine} / {name}\033[K", end="", flush=True)
+            current.setdefault(engine, {})[name] = bench(engine, name, fw, args.repeat, args.seed)
+    print("\r\033[K", end="")
+    print_table(current)
+
+    path = Path(args.baseline)
+    if args.update_baseline:
+        stored = json.loads(path.read_text())['results'] if path.exists() else {}
+        for engine, results in current.items():
+            stored.setdefault(engine, {}).update(results)
+        path.write_text(json.dumps({'created': time.strftime('%Y-%m-%d'), 'numpy': np.__version__,
+                                    'seed': args.seed, 'results': stored}, indent=2) + "\n")
+        print(f"\n💾 Baseline saved to: {path}")
+        return 0
+
+    if not path.exists():
+        print(f"\n⚠ No baseline at {path} - run with --update-baseline")
+        return 0
+    regressions, warnings = compare(current, json.loads(path.read_text())['results'])
+    for w in warnings:
+        print(f"  ⚠ {w}")
+    for r in regressions:
+        print(f"  ❌ {r}")
+    if regressions:
+        print(f"\n❌ {len(regressions)} regression{'s' if len(regressions) != 1 else ''} against {path.name}")
+        return 1
+    print(f"\n✅ No regressions against {path.name}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main() or 0)
@@ -6,15 +6,18 @@ Listens to microphone and finds optimal piezo frequency during calibration sweep
 Usage:
     python buzzer_analyzer.py              # Real-time analysis
     python buzzer_analyzer.py --record     # Record sweep and analyze
+    python buzzer_analyzer.py --track      # Stabilize peak with Kalman tracker
+    python buzzer_analyzer.py -i sweep.wav # Analyze a recorded sweep
     python buzzer_analyzer.py --help       # Show help
 """
 
 import argparse
+import math
 import sys
 import time
 import signal
 from datetime import datetime
-from collections import deque
+from collections import deque, namedtuple
 from pathlib import Path
 
 import numpy as np
@@ -37,6 +40,19 @@ FREQ_MIN = 2400
 FREQ_MAX = 3000
 FREQ_STEP = 100
 
+# Piezo resonance modes measured with 10 Hz sweeps (PIEZO_RESEARCH.md)
+PIEZO_MODES = [2422, 2508, 2605, 2702, 2799, 2917]
+
+# Firmware calibration table written by --fit-modes --write-header
+CALIB_HEADER = Path(__file__).with_name("calib_modes.h")
+CALIB_FREQ_MIN = 2400  # load_freq_from_eeprom() falls back to DEFAULT_FREQ outside this range
+CALIB_FREQ_MAX = 4500
+
+# Calibration history: one row per analyzed run (--db, --query, --history)
+UNIT_DB = Path(__file__).with_name("buzzer_units.db")
+FIRMWARE_SOURCES = ("main.c", "calib_modes.h")  # Hashed into the default firmware build ID
+UNKNOWN_FIRMWARE = "unknown"  # Build stored for imported recordings that don't carry one
+
 # Intro beeps (for auto-detection)
 INTRO_FREQ = 2500      # DEFAULT_FREQ in firmware
 INTRO_BEEP_MS = 400    # BEEP_LONG_MS
@@ -51,11 +67,649 @@ MIN_TONE_DURATION = 0.5  # Minimum tone duration in seconds
 DB_REFERENCE = 1e-5  # Reference for dB calculation
 SMOOTHING_ALPHA = 0.3  # EMA smoothing for display
 
+# Stage timing hub for every SpectrumAnalyzer (StageProfiler, set by --profile)
+PROFILER = None
+PROFILE_HIST_MIN_NS = 1000    # Block times go into log buckets from 1 µs...
+PROFILE_HIST_STEP = 1.05      # ... each 5% wider (percentiles within ±2.5%)...
+PROFILE_HIST_BUCKETS = 400    # ... up to ~5 min: fixed memory however long the session
+
+# Native DSP core (dsp_core.c, 'make dsp'); NATIVE is the loaded NativeDSP with --engine native,
+# the default engine of every SpectrumAnalyzer
+DSP_LIB = Path(__file__).with_name("dsp_core.so")
+NATIVE = None
+
+# Live display
+LIVE_REFRESH_S = 0.05        # Renderer poll interval; it redraws only when a new block arrived
+LIVE_DB_RANGE = (-90, -10)   # Fixed dB scale of the multi-row spectrum and waterfall
+WATERFALL_CHARS = " .:-=+*#%@"
+
+# Audibility scoring
+HARMONIC_AUDIBLE_DB = -50        # Harmonic counts as audible above this level
+SCORE_WEIGHTS = (1.0, 1.0, 0.5)  # (fundamental dB, harmonic gain dB, per audible harmonic)
+
+# Loudness model
+LOUDNESS_SPL_OFFSET_DB = 100  # dB SPL of a full-scale sine (mic calibration, approximate)
+BARK_EDGES_HZ = [0, 100, 200, 300, 400, 510, 630, 770, 920, 1080, 1270, 1480, 1720,
+                 2000, 2320, 2700, 3150, 3700, 4400, 5300, 6400, 7700, 9500, 12000, 15500]
+
+# Input health
+CLIP_LEVEL = 0.99         # |sample| at or above this counts as clipped
+DC_WARN = 0.02            # DC offset (full scale) flagged as a gain/coupling problem
+
+# Onset analysis (--onsets)
+ONSET_BAND_HZ = 500       # Analytic-signal band around the tone (± Hz)
+ONSET_SETTLE_HZ = 10      # Tone counts as settled within this of its final frequency
+ONSET_SMOOTH_MS = 1.0     # Instantaneous-frequency smoothing
+ONSET_TRACE_MS = (0, 1, 2, 5, 10, 20, 50)  # Points of the settling trace
+
+# Latency measurement (--latency)
+SPEED_OF_SOUND = 343.0      # m/s
+LATENCY_WINDOW_MS = 200     # Search window for the acoustic onset after a BUZ- edge
+LATENCY_MIN_GAP_MS = 5      # Edges closer than this are one edge (debounce)
+
+# Direction finding (--find)
+FIND_MIC_SPACING_M = 0.06   # Stereo mic spacing; < half wavelength keeps the fundamental unambiguous
+FIND_BAND_HZ = 60           # Bins used around each harmonic of the buzzer frequency
+FIND_HARMONICS = 3          # Harmonics included in the cross-correlation
+FIND_UPSAMPLE = 8           # Correlation interpolation factor (sub-sample delay)
+FIND_MIN_CONFIDENCE = 0.3   # Below this a block doesn't update the bearing
+FIND_SMOOTHING = 0.4        # EMA weight of a full-confidence block
+
+# Matched-filter search in long recordings (--search)
+SEARCH_FRAME = 2048          # STFT frame (~46 ms, 21.5 Hz bins)
+SEARCH_HOP = 512             # STFT hop (~11.6 ms)
+SEARCH_FREQ_TOL_HZ = 60      # Tone may sit this far from --freq (mode locking, drift)
+SEARCH_CADENCE_MS = (500, 500)  # Beep on/off (Betaflight RX-lost beeper)
+SEARCH_CYCLES = 3            # Beep cycles integrated by the matched filter
+SEARCH_THRESHOLD_SIGMA = 5.0  # Detection threshold in noise standard deviations
+SEARCH_CHUNK_S = 60          # Streaming chunk length
+
+# Identity beacon decoding (--decode-ids), must match firmware
+ID_CHANNELS = 7             # Hop channels, FREQ_STEP apart
+ID_FRAME = 1024             # STFT frame (~23 ms, 43 Hz bins)
+ID_HOP = 512                # STFT hop (~11.6 ms)
+ID_PEAK_DB = 12             # Spectral peak must exceed the band median by this
+ID_FREQ_TOL_HZ = 30         # Same segment / hop-size tolerance
+ID_MIN_FRAMES = 3           # Shortest segment (frames) that counts as a slot
+ID_LINK_MS = 50             # Next segment must start within this of the previous one's end
+ID_CONFIRM_HOPS = 2         # Consistent hops before a unit is reported
+
+# Armed auto-triggered recording (--arm)
+ARM_FREQ_TOL_HZ = 60         # Intro beeps at INTRO_FREQ ± this
+ARM_BEEP_S = (0.25, 0.7)     # Accepted intro beep length (INTRO_BEEP_MS, block-quantized)
+ARM_GAP_S = (0.1, 0.6)       # Accepted pause between the intro beeps (INTRO_PAUSE_MS)
+ARM_PRETRIGGER_S = 0.3       # Recording starts this long before the first intro beep
+ARM_RING_S = 3.0             # Audio kept while armed (must cover intro + pre-trigger)
+ARM_TAIL_S = 0.3             # Keep recording this long after the last sweep tone
+ARM_SILENCE_S = 4.0          # Stop early after this much silence (unit powered off)
+CALIB_TONE_S = 1.5           # CALIB_TONE_MS in firmware
+CALIB_PAUSE_S = 0.5          # CALIB_PAUSE_MS in firmware
+
+# Headless JSON-lines stream (--stream)
+STREAM_QUEUE_LINES = 4096    # Lines buffered per consumer before block events are dropped
+STREAM_STALL_S = 2.0         # A socket client that can't take a tone/sweep event this long is dropped
+
+# Multi-channel calibration station (--station)
+STATION_QUEUE_BLOCKS = 32    # Blocks buffered between the audio callback and the analyzers
+
+# Fleet batch analysis (--batch)
+FLEET_MODE_GAP_HZ = 40       # Mode centers further than this from a fleet mode don't belong to it
+FLEET_MODE_SUPPORT = 0.3     # Fleet mode needs centers from this share of units
+FLEET_MIN_GAIN_DB = -30      # Weaker fitted modes are ignored (dead/unconstrained)
+FLEET_OUTLIER_Z = 3.5        # Robust z-score (median/MAD) flagged as outlier
+FLEET_MIN_SIGMA_HZ = 5       # Spread floor, so a very uniform fleet doesn't flag 1 Hz offsets
+
+# Incremental tone log written while recording (--record, --recover)
+TONE_LOG_SYNC_S = 1.0        # Minimum time between fsyncs; tones closed meanwhile share one
+
+# Binary recording format (--save-rec, --input *.bzr)
+REC_CHUNK_BLOCKS = 256       # Blocks per compressed chunk (~24 s)
+REC_SPECTRUM_STEP_DB = 0.01  # Stored spectrum resolution
+REC_HARMONICS = 5            # Harmonic columns per block
+
+# Betaflight beeper decoding (--beeper)
+BEEPER_FRAME = 512          # Envelope frame (~11.6 ms; Betaflight times beeps in 10 ms units)
+BEEPER_ON_DB = 15           # Frame counts as beeping this far above the noise floor
+BEEPER_SEQ_GAP_S = 0.45     # Silence that ends a pattern (longest in-pattern pause is 400 ms)
+BEEPER_TOL_MS = 35          # Duration match tolerance (or 30%, whichever is larger)
+BEEPER_TOL_REL = 0.3
+
+# Betaflight beeper sequences (src/main/io/beeper.c), alternating on/off in
+# 10 ms units with the trailing pause dropped; repeating ones are replayed
+# while their condition lasts
+BEEPER_PATTERNS = {
+    'GYRO_CALIBRATED': [20, 10, 20, 10, 20],
+    'RX_LOST': [50],
+    'RX_LOST_LANDING': [10, 10, 10, 10, 10, 40, 40, 10, 40, 10, 40, 40, 10, 10, 10, 10, 10],
+    'DISARMING': [15, 5, 15],
+    'ARMING': [30, 5, 5],
+    'ARMED': [10, 5, 30, 5, 10, 5, 30],
+    'ARMING_GPS_FIX': [5, 5, 15, 5, 5, 5, 15],
+    'BAT_CRIT_LOW': [50],
+    'BAT_LOW': [25],
+    'RX_SET': [10],
+    'DISARM_REPEAT': [10],
+    'ACC_CALIBRATION': [5, 5, 5],
+    'ACC_CALIBRATION_FAIL': [20, 15, 35],
+    'READY_BEEP': [4, 5, 4, 5, 8, 5, 15, 5, 8, 5, 4, 5, 4],
+    'CAM_CONNECTION_OPEN': [5, 15, 10, 15, 20],
+    'CAM_CONNECTION_CLOSE': [10, 8, 5],
+    'RC_SMOOTHING_INIT_FAIL': [10, 10, 10, 10, 10, 10, 50],
+}
+# Repeat period (ms) that separates events sharing a single-beep pattern
+BEEPER_REPEAT_MS = {'RX_LOST': 1000, 'BAT_CRIT_LOW': 520, 'BAT_LOW': 750, 'DISARM_REPEAT': 1100}
+
+# Oscillator drift study (--drift)
+DRIFT_SUBBLOCK_MS = 10      # Phasor length; consecutive phasors give ±50 Hz unambiguous range
+DRIFT_INTERVAL_S = 1.0      # One frequency estimate per interval
+DRIFT_MIN_PURITY = 0.1      # Share of sub-block energy in the tone for it to count
+DRIFT_MIN_PAIRS = 10        # Phasor pairs needed for an interval estimate
+DRIFT_JUMP_HZ = 40          # A bigger step re-acquires (new tone, not drift)
+DRIFT_DEFAULT_Q = 40        # Mode Q assumed without --modes (half-power band center/Q)
+DRIFT_HISTORY_MIN = 24 * 60  # Per-minute means kept for the trend (bounded memory)
+DRIFT_ALLAN_LEVELS = 16     # Octave averaging times: 1 s ... ~9 h
+
+# Noise suppression (--denoise)
+NOISE_LEARN_S = 1.0         # Initial noise-profile learning time (keep buzzer silent)
+NOISE_OVERSUBTRACT = 2.0    # Spectral subtraction over-subtraction factor
+NOISE_FLOOR_GAIN = 0.05     # Spectral floor: never attenuate a bin below this gain
+NOISE_ATTACK = 0.3          # Profile update rate when a bin falls below the profile
+NOISE_RELEASE = 0.01        # Profile update rate when a bin rises above it (slow)
+
+# Peak tracker (--track)
+TRACK_PROCESS_NOISE_HZ = 1.5  # Expected fundamental wander per block (Hz)
+TRACK_GATE_SIGMA = 4.0        # Innovation gate for outlier rejection (std devs)
+TRACK_MAX_MISSES = 3          # Consecutive rejections before re-acquiring
+
+
+class PeakTracker:
+    """Kalman tracker for the fundamental across blocks.
+
+    State is [frequency, drift per block]. Each block's argmax is refined
+    with parabolic interpolation, then gated against the prediction:
+    outliers (e.g. a neighbouring mode winning one block) are rejected
+    instead of followed. The measurement only comes from FREQ_MIN..FREQ_MAX,
+    so octave jumps can't reach the tracker in the first place.
+    After TRACK_MAX_MISSES rejections in a row (or after silence) the
+    tracker re-acquires on the raw peak, so sweep steps are picked up.
+    Cost is a handful of float ops per block.
+    """
+
+    def __init__(self, freq_resolution, process_noise=TRACK_PROCESS_NOISE_HZ,
+                 gate_sigma=TRACK_GATE_SIGMA, max_misses=TRACK_MAX_MISSES):
+        self.freq_resolution = freq_resolution
+        q = process_noise ** 2
+        self.Q = np.array([[q / 4, q / 2], [q / 2, q]])
+        self.gate_sigma = gate_sigma
+        self.max_misses = max_misses
+        self.reset()
+
+    def reset(self):
+        self.x = None               # [freq, drift]
+        self.P = None
+        self.misses = 0
+        self.confidence = 0.0
+
+    def _measurement_var(self, snr_db):
+        # ~0.3 bin std at 20 dB SNR, growing as SNR drops
+        sigma = 0.3 * self.freq_resolution * 10 ** (-(min(snr_db, 40) - 20) / 20)
+        return sigma ** 2
+
+    def _acquire(self, freq, r):
+        self.x = np.array([freq, 0.0])
+        self.P = np.array([[r, 0.0], [0.0, self.Q[1, 1] * 4]])
+        self.misses = 0
+        self.confidence = 0.5
+
+    def update(self, freq, snr_db, present=True):
+        """Feed one block's measured peak. Returns (freq_estimate, confidence)."""
+        if not present:
+            # Silence: drop lock so the next tone is acquired fresh
+            self.reset()
+            return 0.0, 0.0
+
+        r = self._measurement_var(snr_db)
+        if self.x is None:
+            self._acquire(freq, r)
+            return freq, self.confidence
+
+        # Predict
+        F = np.array([[1.0, 1.0], [0.0, 1.0]])
+        x = F @ self.x
+        P = F @ self.P @ F.T + self.Q
+
+        innovation = freq - x[0]
+        s = P[0, 0] + r
+
+        if innovation ** 2 > (self.gate_sigma ** 2) * s:
+            self.misses += 1
+            if self.misses >= self.max_misses:
+                # Persistent offset: the tone really moved
+                self._acquire(freq, r)
+                return freq, self.confidence
+            self.x, self.P = x, P
+            self.confidence *= 0.5
+            return x[0], self.confidence
+
+        # Update
+        k = P[:, 0] / s
+        self.x = x + k * innovation
+        self.P = P - np.outer(k, P[0, :])
+        self.misses = 0
+        likelihood = np.exp(-0.5 * innovation ** 2 / s)
+        self.confidence = 0.7 * self.confidence + 0.3 * likelihood
+        return self.x[0], self.confidence
+
+
+class NoiseSuppressor:
+    """Spectral subtraction against a learned noise profile.
+
+    The profile is the mean magnitude of the first NOISE_LEARN_S seconds,
+    then follows the noise floor per bin: quickly downwards, slowly
+    upwards, so motors spooling up are learned within a few seconds while
+    a 1.5 s calibration tone barely leaks in. Stationary motor/prop
+    harmonics are part of the profile and get removed along with the
+    broadband noise.
+
+    Works on the current block only: no added latency, ~3 vector ops
+    over the spectrum per block.
+    """
+
+    def __init__(self, n_bins, learn_blocks):
+        self.profile = np.zeros(n_bins)
+        self.learn_blocks = max(1, learn_blocks)
+        self.blocks_seen = 0
+
+    @property
+    def learning(self):
+        return self.blocks_seen < self.learn_blocks
+
+    def process(self, magnitude):
+        """Return noise-suppressed magnitude spectrum"""
+        self.blocks_seen += 1
+        if self.blocks_seen <= self.learn_blocks:
+            self.profile += (magnitude - self.profile) / self.blocks_seen
+            return magnitude * NOISE_FLOOR_GAIN
+
+        rate = np.where(magnitude < self.profile, NOISE_ATTACK, NOISE_RELEASE)
+        self.profile += rate * (magnitude - self.profile)
+        return np.maximum(magnitude - NOISE_OVERSUBTRACT * self.profile,
+                          NOISE_FLOOR_GAIN * magnitude)
+
+
+class DirectionFinder:
+    """Bearing to the buzzer from a stereo mic pair (GCC-PHAT).
+
+    The cross-spectrum of the two channels is whitened (PHAT) and kept
+    only around the buzzer frequency and its first harmonics, so motors,
+    wind and voices don't pull the estimate. The inverse FFT, zero-padded
+    FIND_UPSAMPLE times, gives the inter-mic delay to a fraction of a
+    sample; bearing = asin(c * delay / spacing), 0° straight ahead,
+    positive towards the right (channel 1) mic. A two-mic pair can't
+    tell front from back - turn around and compare.
+
+    Per block: two rfft plus one zero-padded irfft, ~1 ms at 4096 samples.
+    """
+
+    def __init__(self, freq, sample_rate=SAMPLE_RATE, block_size=BLOCK_SIZE,
+                 spacing_m=FIND_MIC_SPACING_M):
+        self.sample_rate = sample_rate
+        self.block_size = block_size
+        self.spacing_m = spacing_m
+        self.window = np.hanning(block_size)
+        freqs = np.fft.rfftfreq(block_size, 1 / sample_rate)
+        self.mask = np.zeros(len(freqs), dtype=bool)
+        for n in range(1, FIND_HARMONICS + 1):
+            self.mask |= np.abs(freqs - n * freq) <= FIND_BAND_HZ
+
+        self.n_corr = block_size * FIND_UPSAMPLE
+        self.max_lag = int(np.ceil(spacing_m / SPEED_OF_SOUND * sample_rate * FIND_UPSAMPLE)) + 1
+        # Correlation peak of a perfectly coherent source, for normalization
+        self.full_scale = np.fft.irfft(self.mask.astype(float), n=self.n_corr)[0]
+
+        self.bearing = None
+        self.confidence = 0.0
+        self.delay_us = 0.0
+
+    def process(self, block):
+        """Update from one stereo block [frames, 2]. Returns (bearing_deg, confidence)"""
+        x1 = np.fft.rfft(block[:, 0] * self.window)
+        x2 = np.fft.rfft(block[:, 1] * self.window)
+        cross = x2 * np.conj(x1)
+        cross = np.where(self.mask, cross / (np.abs(cross) + 1e-20), 0)
+        corr = np.fft.irfft(cross, n=self.n_corr)
+
+        # Lags -max_lag..+max_lag (circular); positive lag = channel 1 later
+        region = np.concatenate([corr[-self.max_lag:], corr[:self.max_lag + 1]])
+        i = int(np.argmax(region))
+        offset = 0.0
+        if 0 < i < len(region) - 1:
+            a, b, c = region[i - 1], region[i], region[i + 1]
+            denom = a - 2 * b + c
+            offset = 0.5 * (a - c) / denom if denom else 0.0
+        lag = (i - self.max_lag + offset) / (self.sample_rate * FIND_UPSAMPLE)
+        confidence = float(np.clip(region[i] / self.full_scale, 0, 1))
+
+        if confidence >= FIND_MIN_CONFIDENCE:
+            # Channel 1 hearing it later means the source is on the channel 0 side
+            ratio = np.clip(-lag * SPEED_OF_SOUND / self.spacing_m, -1, 1)
+            bearing = float(np.degrees(np.arcsin(ratio)))
+            alpha = FIND_SMOOTHING * confidence
+            self.bearing = bearing if self.bearing is None else (
+                alpha * bearing + (1 - alpha) * self.bearing)
+            self.delay_us = lag * 1e6
+        self.confidence = confidence
+        return self.bearing, confidence
+
+
+def bearing_gauge(bearing, width=41):
+    """ASCII gauge from -90° (left) to +90° (right)"""
+    cells = ["·"] * width
+    cells[width // 2] = "|"
+    if bearing is not None:
+        cells[int(round((bearing + 90) / 180 * (width - 1)))] = "▲"
+    return "L [" + "".join(cells) + "] R"
+
+
+class LoudnessModel:
+    """Zwicker-style loudness over the 24 critical (Bark) bands.
+
+    Band powers come from the block spectrum via one reduceat, are spread
+    across neighbouring bands (27 dB/Bark below, 10 dB/Bark above) and
+    converted to specific loudness with Zwicker's formula against the
+    threshold in quiet. Total loudness is returned in sones; phon_from_sone()
+    converts. Absolute values depend on LOUDNESS_SPL_OFFSET_DB, the ranking
+    between tones does not.
+    """
+
+    def __init__(self, freqs, window, spl_offset=LOUDNESS_SPL_OFFSET_DB):
+        edges = [e for e in BARK_EDGES_HZ if e < freqs[-1]]
+        self.band_starts = np.searchsorted(freqs, edges)
+        n_bands = len(self.band_starts)
+        bounds = edges + [freqs[-1]]
+        centers = np.array([(bounds[i] + bounds[i + 1]) / 2 for i in range(n_bands)])
+
+        # One-sided power of a bin, in units of full-scale sine power
+        self.power_scale = 2 * len(window) / np.sum(window ** 2) / 0.5
+        self.spl_offset = spl_offset
+
+        # Threshold in quiet at band centers (Terhardt)
+        khz = np.maximum(centers, 50) / 1000
+        self.ltq = (3.64 * khz ** -0.8 - 6.5 * np.exp(-0.6 * (khz - 3.3) ** 2)
+                    + 1e-3 * khz ** 4)
+
+        # Spreading matrix (power domain), rows = receiving band
+        dz = np.arange(n_bands)[:, None] - np.arange(n_bands)[None, :]
+        spread_db = np.where(dz >= 0, -10.0 * dz, 27.0 * dz)
+        self.spread = 10 ** (spread_db / 10)
+
+    def sones(self, magnitude):
+        """Total loudness (sones) of one block from its linear magnitude spectrum"""
+        return self.sones_from_bands(np.add.reduceat(magnitude ** 2, self.band_starts))
+
+    def sones_from_bands(self, band_power):
+        """Total loudness (sones) from per-band sums of squared magnitude"""
+        band_power = band_power * self.power_scale
+        excitation = self.spread @ band_power
+        level = 10 * np.log10(excitation + 1e-20) + self.spl_offset
+        specific = 0.0635 * 10 ** (0.025 * self.ltq) * (
+            (0.75 + 0.25 * 10 ** (0.1 * (level - self.ltq))) ** 0.25 - 1)
+        return float(np.sum(np.maximum(specific, 0)))
+
+
+def phon_from_sone(sones):
+    """Loudness level (phon) from loudness (sone)"""
+    if sones >= 1:
+        return 40 + 10 * np.log2(sones)
+    return 40 * (sones + 0.0005) ** 0.35
+
+
+class StageProfiler:
+    """Per-stage timing counters for SpectrumAnalyzer.process_audio() (--profile).
+
+    Stages are timed with perf_counter_ns() laps; the counters are plain
+    integer sums, max and call counts (a few hundred ns per block). Block
+    totals go into a fixed log-bucket histogram (PROFILE_HIST_*) for the
+    percentiles, plus exact count, sum and max, and are checked for
+    deadline misses: a block must finish within block_size / sample_rate,
+    or the audio callback falls behind.
+
+    The --profile instance is a hub: every SpectrumAnalyzer times itself
+    on its own child() (so --station's worker threads never share
+    counters), --batch workers send their state() back to be absorb()ed,
+    and summary() merges it all. overflow() counts input overflows that
+    sounddevice reports to any audio callback (count_overflow()).
+    """
+
+    def __init__(self):
+        import threading
+        self.total_ns = {}
+        self.max_ns = {}
+        self.calls = {}
+        self.block_hist = [0] * PROFILE_HIST_BUCKETS
+        self.block_count = 0
+        self.block_sum_ns = 0
+        self.block_max_ns = 0
+        self.misses = 0
+        self.overflows = 0
+        self.deadline_ns = None
+        self.children = []
+        self.lock = threading.Lock()
+
+    def child(self):
+        """New profiler for one analyzer, merged into this one's summary()"""
+        child = StageProfiler()
+        with self.lock:
+            self.children.append(child)
+        return child
+
+    clock = staticmethod(time.perf_counter_ns)
+
+    def lap(self, stage, t):
+        """Charge the time since t to stage; returns the new lap start"""
+        now = time.perf_counter_ns()
+        dt = now - t
+        self.total_ns[stage] = self.total_ns.get(stage, 0) + dt
+        self.calls[stage] = self.calls.get(stage, 0) + 1
+        if dt > self.max_ns.get(stage, 0):
+            self.max_ns[stage] = dt
+        return now
+
+    def block(self, t0, deadline_s):
+        """Close one block started at t0 and check it against its deadline"""
+        dt = time.perf_counter_ns() - t0
+        bucket = int(math.log(max(dt, PROFILE_HIST_MIN_NS) / PROFILE_HIST_MIN_NS) / math.log(PROFILE_HIST_STEP))
+        self.block_hist[min(bucket, PROFILE_HIST_BUCKETS - 1)] += 1
+        self.block_count += 1
+        self.block_sum_ns += dt
+        self.block_max_ns = max(self.block_max_ns, dt)
+        self.deadline_ns = int(deadline_s * 1e9)
+        if dt > self.deadline_ns:
+            self.misses += 1
+
+    def overflow(self, status):
+        if status and status.input_overflow:
+            with self.lock:
+                self.overflows += 1
+
+    def state(self):
+        """Raw counters of this profiler and its children, as plain picklable data"""
+        merged = StageProfiler()
+        merged.absorb(self._own_state())
+        with self.lock:
+            children = list(self.children)
+        for child in children:
+            merged.absorb(child.state())
+        return merged._own_state()
+
+    def _own_state(self):
+        return {'total_ns': dict(self.total_ns), 'max_ns': dict(self.max_ns), 'calls': dict(self.calls),
+                'block_hist': list(self.block_hist), 'block_count': self.block_count,
+                'block_sum_ns': self.block_sum_ns, 'block_max_ns': self.block_max_ns,
+                'misses': self.misses, 'overflows': self.overflows,
+                'deadline_ns': self.deadline_ns}
+
+    def absorb(self, state):
+        """Add another profiler's state() (e.g. from a --batch worker process)"""
+        with self.lock:
+            for stage, ns in state['total_ns'].items():
+                self.total_ns[stage] = self.total_ns.get(stage, 0) + ns
+                self.calls[stage] = self.calls.get(stage, 0) + state['calls'][stage]
+                self.max_ns[stage] = max(self.max_ns.get(stage, 0), state['max_ns'][stage])
+            self.block_hist = [a + b for a, b in zip(self.block_hist, state['block_hist'])]
+            self.block_count += state['block_count']
+            self.block_sum_ns += state['block_sum_ns']
+            self.block_max_ns = max(self.block_max_ns, state['block_max_ns'])
+            self.misses += state['misses']
+            self.overflows += state['overflows']
+            self.deadline_ns = self.deadline_ns or state['deadline_ns']
+
+    def summary(self):
+        """Report dict: per-stage mean/max/share and block totals (µs), children included"""
+        st = self.state()
+        blocks = st['block_count']
+        total_ns, calls, max_ns = st['total_ns'], st['calls'], st['max_ns']
+        total = sum(total_ns.values()) or 1
+        stages = {name: {'calls': calls[name],
+                         'mean_us': total_ns[name] / calls[name] / 1000,
+                         'max_us': max_ns[name] / 1000,
+                         'share': total_ns[name] / total}
+                  for name in total_ns}
+        report = {'blocks': blocks, 'stages': stages, 'misses': st['misses'],
+                  'overflows': st['overflows']}
+        if blocks:
+            deadline_us = st['deadline_ns'] / 1000
+            mean_us = st['block_sum_ns'] / blocks / 1000
+            max_us = st['block_max_ns'] / 1000
+            report.update(block_mean_us=mean_us,
+                          block_p50_us=min(self._percentile(st['block_hist'], blocks, 0.50), max_us),
+                          block_p99_us=min(self._percentile(st['block_hist'], blocks, 0.99), max_us),
+                          block_max_us=max_us, deadline_us=deadline_us, load=mean_us / deadline_us)
+        return report
+
+    @staticmethod
+    def _percentile(hist, count, q):
+        """q-quantile of a block_hist in µs: the geometric middle of the bucket holding it"""
+        cumulative = 0
+        for i, n in enumerate(hist):
+            cumulative += n
+            if cumulative >= q * count:
+                break
+        return PROFILE_HIST_MIN_NS * PROFILE_HIST_STEP ** (i + 0.5) / 1000
+
+    def report(self, path=None):
+        """Print the summary table; also write it as JSON to path"""
+        report = self.summary()
+        print(f"\n⏱️  PROFILE: {report['blocks']} blocks")
+        if report['blocks']:
+            print("-" * 60)
+            print(f"  {'Stage':<14} {'Calls':>8} {'Mean µs':>10} {'Max µs':>10} {'Share':>8}")
+            for name, st in sorted(report['stages'].items(), key=lambda kv: -kv[1]['share']):
+                print(f"  {name:<14} {st['calls']:>8} {st['mean_us']:>10.1f} {st['max_us']:>10.1f} "
+                      f"{st['share']:>7.1%}")
+            print("-" * 60)
+            print(f"  Block: mean {report['block_mean_us']:.0f} µs, p50 {report['block_p50_us']:.0f} µs, "
+                  f"p99 {report['block_p99_us']:.0f} µs, max {report['block_max_us']:.0f} µs")
+            print(f"  Deadline {report['deadline_us'] / 1000:.1f} ms: load {report['load']:.2%}, "
+                  f"{report['misses']} missed, {report['overflows']} input overflows")
+        else:
+            print(f"  {report['overflows']} input overflows")
+        if path:
+            import json
+            with open(path, 'w') as f:
+                json.dump(report, f, indent=2)
+            print(f"  💾 Profile saved to: {path}")
+
+
+def count_overflow(status):
+    """Count a sounddevice input overflow with --profile (call from every audio callback)"""
+    if PROFILER:
+        PROFILER.overflow(status)
+
+
+class NativeDSP:
+    """ctypes binding of the native DSP core (dsp_core.c, built with 'make dsp').
+
+    Kernels for --engine native: fused input health + windowing,
+    magnitude, dB + Bark band power, harmonic bins and tone
+    segmentation, SIMD-vectorized in C. They only read and write arrays
+    owned by the caller (contiguous float64/int64, allocated once per
+    SpectrumAnalyzer), and ctypes releases the GIL for each call.
+    Arrays may be passed as their address() instead: .ctypes.data costs
+    more than most of the kernels, so callers look it up once per buffer.
+    load() returns None when the library hasn't been built.
+    """
+
+    def __init__(self, path=DSP_LIB):
+        import ctypes
+        lib = ctypes.CDLL(str(path))
+        ptr, cint, cdouble = ctypes.c_void_p, ctypes.c_int, ctypes.c_double
+        signatures = {
+            'bz_health_window': (None, [ptr, ptr, ptr, cint, cdouble, ptr]),
+            'bz_magnitude': (None, [ptr, ptr, cint, cdouble]),
+            'bz_db_bands': (None, [ptr, ptr, cint, cdouble, ptr, cint, ptr]),
+            'bz_harmonics': (cint, [ptr, ptr, cint, cdouble, cdouble, cint, cdouble, cdouble, ptr, ptr]),
+            'bz_segment': (cint, [ptr, ptr, cint, cdouble, cdouble, cint, ptr, ptr]),
+        }
+        for name, (restype, argtypes) in signatures.items():
+            func = getattr(lib, name)
+            func.restype = restype
+            func.argtypes = argtypes
+        self.lib = lib
+        self.path = str(path)
+
+    @classmethod
+    def load(cls, path=DSP_LIB):
+        try:
+            return cls(path)
+        except OSError:
+            return None
+
+    @staticmethod
+    def address(a):
+        """Data pointer of array a (or a itself if it already is one)"""
+        return a if isinstance(a, int) else a.ctypes.data
+
+    def health_window(self, x, window, out, stats, n):
+        """out = x * window; stats = (max |x|, sum, sum of squares, clipped count)"""
+        addr = self.address
+        self.lib.bz_health_window(addr(x), addr(window), addr(out), n, CLIP_LEVEL, addr(stats))
+
+    def magnitude(self, fft, out, n_bins, scale):
+        self.lib.bz_magnitude(self.address(fft), self.address(out), n_bins, scale)
+
+    def db_bands(self, magnitude, out_db, n_bins, band_starts, n_bands, band_power):
+        addr = self.address
+        self.lib.bz_db_bands(addr(magnitude), addr(out_db), n_bins, DB_REFERENCE,
+                             addr(band_starts), n_bands, addr(band_power))
+
+    def harmonics(self, spectrum_db, freqs, n_bins, fundamental, nyquist, max_harmonic, tolerance_hz,
+                  resolution, out_n, out_idx):
+        """Fill out_n with harmonic numbers and out_idx with their bins; returns the count"""
+        addr = self.address
+        return self.lib.bz_harmonics(addr(spectrum_db), addr(freqs), n_bins, fundamental, nyquist,
+                                     max_harmonic, tolerance_hz, resolution, addr(out_n), addr(out_idx))
+
+    def segment(self, t, db, threshold_db, min_duration, min_samples):
+        """[start, end) entry ranges of the tones in (t, db)"""
+        n = len(t)
+        starts = np.empty(n // 2 + 1, dtype=np.int64)
+        ends = np.empty(n // 2 + 1, dtype=np.int64)
+        count = self.lib.bz_segment(t.ctypes.data, db.ctypes.data, n, threshold_db, min_duration,
+                                    min_samples, starts.ctypes.data, ends.ctypes.data)
+        return list(zip(starts[:count].tolist(), ends[:count].tolist()))
+
+
+# Immutable per-block state for display threads (SpectrumAnalyzer.snapshot())
+BlockSnapshot = namedtuple('BlockSnapshot', 'peak_freq peak_db harmonics smoothed spectrum '
+                                            'tracking track_confidence learning clip_hold dc_offset')
+
 
 class SpectrumAnalyzer:
     """Real-time audio spectrum analyzer"""
 
-    def __init__(self, sample_rate=SAMPLE_RATE, block_size=BLOCK_SIZE):
+    def __init__(self, sample_rate=SAMPLE_RATE, block_size=BLOCK_SIZE, track=False,
+                 spl_offset=LOUDNESS_SPL_OFFSET_DB, denoise=False, keep_audio=False, engine=None):
         self.sample_rate = sample_rate
         self.block_size = block_size
         self.freq_resolution = sample_rate / block_size
@@ -73,26 +727,165 @@ class SpectrumAnalyzer:
         self.full_spectrum_db = None  # Full spectrum for harmonics
         self.peak_freq = 0
         self.peak_db = -100
+        self.harmonics = []  # find_harmonics() of the last block
+        self.sones = 0.0
+
+        # Input health of the last block (raw samples, before any processing)
+        self.clipped = 0
+        self.dc_offset = 0.0
+        self.rms_db = -100.0
+        self.clip_hold = 0  # Blocks left to keep showing a clip warning
+
+        # Optional noise suppression ahead of peak detection
+        self.denoiser = None
+        if denoise:
+            self.denoiser = NoiseSuppressor(len(self.freqs),
+                                            int(NOISE_LEARN_S * sample_rate / block_size))
+
+        # Optional fundamental tracker
+        self.tracker = PeakTracker(self.freq_resolution) if track else None
+        self.track_freq = 0
+        self.track_confidence = 0.0
 
         # Recording
         self.recording = False
-        self.recorded_peaks = []  # List of (timestamp, freq, db, harmonics)
+        self.recorded_peaks = []  # List of (timestamp, freq, db, harmonics, info)
         self.start_time = None
+        self.keep_audio = keep_audio  # Keep raw samples for onset analysis
+        self.recorded_audio = []
+        self.recorded_samples = 0
+        self.recorder = None  # Optional RecordingWriter fed every recorded block
+        self.tone_log = None  # Optional ToneLog fed every recorded block
+        self.profiler = PROFILER.child() if PROFILER else None  # Optional StageProfiler (--profile)
 
         # Window function for better FFT
         self.window = np.hanning(block_size)
 
-    def process_audio(self, data):
-        """Process audio block and compute spectrum"""
+        self.loudness = LoudnessModel(self.freqs, self.window, spl_offset)
+
+        # Native kernels over preallocated buffers: engine 'native', 'numpy', or None to
+        # follow --engine (NATIVE)
+        self.native = NATIVE if engine is None else None
+        if engine == 'native':
+            self.native = NATIVE or NativeDSP.load()
+            if self.native is None:
+                raise RuntimeError(f"{DSP_LIB.name} is not built - run 'make dsp'")
+        if self.native:
+            import inspect
+            n_bins = len(self.freqs)
+            self._samples = np.empty(block_size)
+            self._windowed = np.empty(block_size)
+            self._fft = np.empty(n_bins, dtype=complex)
+            self._fft_out = 'out' in inspect.signature(np.fft.rfft).parameters  # NumPy >= 2.0
+            self._magnitude = np.empty(n_bins)
+            self._magnitude_db = np.empty(n_bins)
+            self._band_starts = np.ascontiguousarray(self.loudness.band_starts, dtype=np.int64)
+            self._band_power = np.empty(len(self._band_starts))
+            self._stats = np.empty(4)
+            self._harmonic_bins = np.empty((2, 16), dtype=np.int64)  # Grown by find_harmonics() if needed
+            self._ptr = {name: NativeDSP.address(buf) for name, buf in (
+                ('samples', self._samples), ('window', self.window), ('windowed', self._windowed),
+                ('fft', self._fft), ('magnitude', self._magnitude), ('magnitude_db', self._magnitude_db),
+                ('band_starts', self._band_starts), ('band_power', self._band_power),
+                ('stats', self._stats), ('freqs', self.freqs),
+                ('harmonic_n', self._harmonic_bins[0]), ('harmonic_idx', self._harmonic_bins[1]))}
+
+    def process_audio(self, data, timestamp=None):
+        """Process audio block and compute spectrum.
+
+        timestamp: recording time of the block in seconds; defaults to the
+        wall clock since start_recording() (live capture).
+        """
+        prof = self.profiler
+        t0 = t = prof.clock() if prof else 0
+        if self.native:
+            return self._process_native(data, timestamp, prof, t0)
+        samples = data.flatten()
+
+        # Input health: a couple of reductions, clip count only when near full scale
+        peak = max(samples.max(), -samples.min())
+        self.clipped = int(np.count_nonzero(np.abs(samples) >= CLIP_LEVEL)) if peak >= CLIP_LEVEL else 0
+        self.dc_offset = float(samples.mean())
+        self.rms_db = 10 * np.log10(np.dot(samples, samples) / len(samples) + 1e-20)
+        self.clip_hold = 10 if self.clipped else max(0, self.clip_hold - 1)
+        if prof:
+            t = prof.lap('health', t)
+
         # Apply window and compute FFT
-        windowed = data.flatten() * self.window
+        windowed = samples * self.window
+        if prof:
+            t = prof.lap('window', t)
         fft = np.fft.rfft(windowed)
+        if prof:
+            t = prof.lap('rfft', t)
         magnitude = np.abs(fft) / self.block_size
+        if prof:
+            t = prof.lap('magnitude', t)
+
+        if self.denoiser:
+            magnitude = self.denoiser.process(magnitude)
+            if prof:
+                t = prof.lap('denoise', t)
 
         # Convert to dB
         magnitude_db = 20 * np.log10(magnitude + DB_REFERENCE)
         self.full_spectrum_db = magnitude_db
+        if prof:
+            t = prof.lap('db', t)
+
+        # Perceived loudness of the whole block (fundamental + harmonics)
+        self.sones = self.loudness.sones(magnitude)
+        if prof:
+            t = prof.lap('loudness', t)
+
+        return self._finish_block(samples, magnitude_db, timestamp, prof, t, t0)
+
+    def _process_native(self, data, timestamp, prof, t0):
+        """process_audio() front end on the native kernels (--engine native)"""
+        t = t0
+        samples = self._samples
+        np.copyto(samples, data.reshape(-1))
+        ptr = self._ptr
+        n = len(samples)
+        self.native.health_window(ptr['samples'], ptr['window'], ptr['windowed'], ptr['stats'], n)
+        peak, total, squares, clipped = self._stats.tolist()
+        self.clipped = int(clipped) if peak >= CLIP_LEVEL else 0
+        self.dc_offset = float(total / n)
+        self.rms_db = 10 * np.log10(squares / n + 1e-20)
+        self.clip_hold = 10 if self.clipped else max(0, self.clip_hold - 1)
+        if prof:
+            t = prof.lap('health+window', t)
+
+        if self._fft_out:
+            np.fft.rfft(self._windowed, out=self._fft)
+        else:
+            self._fft[:] = np.fft.rfft(self._windowed)
+        if prof:
+            t = prof.lap('rfft', t)
+        magnitude = self._magnitude
+        self.native.magnitude(ptr['fft'], ptr['magnitude'], len(magnitude), 1.0 / self.block_size)
+        if prof:
+            t = prof.lap('magnitude', t)
+
+        if self.denoiser:
+            magnitude = self.denoiser.process(magnitude)
+            if prof:
+                t = prof.lap('denoise', t)
+
+        self.native.db_bands(ptr['magnitude'] if magnitude is self._magnitude else magnitude,
+                             ptr['magnitude_db'], len(magnitude), ptr['band_starts'],
+                             len(self._band_starts), ptr['band_power'])
+        magnitude_db = self._magnitude_db
+        self.full_spectrum_db = magnitude_db
+        if prof:
+            t = prof.lap('db+bands', t)
+        self.sones = self.loudness.sones_from_bands(self._band_power)
+        if prof:
+            t = prof.lap('loudness', t)
+        return self._finish_block(samples, magnitude_db, timestamp, prof, t, t0)
 
+    def _finish_block(self, samples, magnitude_db, timestamp, prof, t, t0):
+        """Peak, tracking, harmonics and recording (shared by both front ends)"""
         # Extract buzzer range
         buzzer_spectrum = magnitude_db[self.buzzer_mask]
 
@@ -109,22 +902,102 @@ class SpectrumAnalyzer:
         peak_idx = np.argmax(buzzer_spectrum)
         self.peak_freq = self.buzzer_freqs[peak_idx]
         self.peak_db = buzzer_spectrum[peak_idx]
+        if prof:
+            t = prof.lap('smooth+peak', t)
+
+        # Track fundamental across blocks (replaces raw argmax when enabled)
+        if self.tracker:
+            self.track_freq, self.track_confidence = self.tracker.update(
+                self.interpolate_peak(buzzer_spectrum, peak_idx),
+                self.peak_db - np.median(buzzer_spectrum),
+                present=self.peak_db > TONE_THRESHOLD_DB)
+            if self.track_freq:
+                self.peak_freq = self.track_freq
+            if prof:
+                t = prof.lap('track', t)
 
         # Detect harmonics
         harmonics = self.find_harmonics(self.peak_freq)
+        self.harmonics = harmonics
+        if prof:
+            t = prof.lap('harmonics', t)
 
         # Record if enabled
         if self.recording and self.start_time:
-            elapsed = time.time() - self.start_time
-            self.recorded_peaks.append((elapsed, self.peak_freq, self.peak_db, harmonics))
+            elapsed = time.time() - self.start_time if timestamp is None else timestamp
+            info = {'sones': self.sones, 'band_db': buzzer_spectrum,
+                    'clipped': self.clipped, 'dc': self.dc_offset, 'rms_db': self.rms_db,
+                    'sample': self.recorded_samples}
+            entry = (elapsed, self.peak_freq, self.peak_db, harmonics, info)
+            self.recorded_peaks.append(entry)
+            if self.recorder:
+                self.recorder.append(entry)
+            if self.tone_log:
+                self.tone_log.push(entry)
+            if self.keep_audio:
+                self.recorded_audio.append(samples.astype(np.float32))
+            self.recorded_samples += len(samples)
+            if prof:
+                prof.lap('record', t)
 
+        if prof:
+            prof.block(t0, self.block_size / self.sample_rate)
         return self.peak_freq, self.peak_db
 
+    def health_str(self):
+        """Short input-health warning for the live display ('' when fine)"""
+        warnings = health_warnings(self.clip_hold, self.dc_offset)
+        if not warnings:
+            return ""
+        return " \033[91m⚠ " + warnings + "\033[0m"
+
+    def snapshot(self):
+        """Immutable copy of the last block's display state.
+
+        Taken in the audio callback right after process_audio(), so a
+        renderer never reads state the next block is mutating.
+        """
+        smoothed = self.smoothed_spectrum.copy()
+        spectrum = self.current_spectrum.copy()
+        smoothed.flags.writeable = False
+        spectrum.flags.writeable = False
+        return BlockSnapshot(
+            peak_freq=float(self.peak_freq), peak_db=float(self.peak_db),
+            harmonics=tuple((h['n'], h['db']) for h in self.harmonics),
+            smoothed=smoothed, spectrum=spectrum,
+            tracking=bool(self.tracker and self.track_freq), track_confidence=self.track_confidence,
+            learning=bool(self.denoiser and self.denoiser.learning),
+            clip_hold=self.clip_hold, dc_offset=self.dc_offset)
+
+    def interpolate_peak(self, spectrum_db, idx):
+        """Refine peak bin to sub-bin frequency (parabolic fit on dB)"""
+        if idx <= 0 or idx >= len(spectrum_db) - 1:
+            return self.buzzer_freqs[idx]
+        a, b, c = spectrum_db[idx - 1], spectrum_db[idx], spectrum_db[idx + 1]
+        denom = a - 2 * b + c
+        offset = 0.5 * (a - c) / denom if denom != 0 else 0.0
+        return self.buzzer_freqs[idx] + offset * self.freq_resolution
+
     def find_harmonics(self, fundamental, max_harmonic=5, tolerance_hz=50):
         """Find harmonics of fundamental frequency and their dB levels"""
         if self.full_spectrum_db is None or fundamental < 100:
             return []
 
+        if self.native:
+            ptr = self._ptr
+            if max_harmonic > self._harmonic_bins.shape[1]:
+                self._harmonic_bins = np.empty((2, max_harmonic), dtype=np.int64)
+                ptr['harmonic_n'] = NativeDSP.address(self._harmonic_bins[0])
+                ptr['harmonic_idx'] = NativeDSP.address(self._harmonic_bins[1])
+            spectrum = self.full_spectrum_db
+            count = self.native.harmonics(ptr['magnitude_db'] if spectrum is self._magnitude_db else spectrum,
+                                          ptr['freqs'], len(self.freqs), fundamental, self.sample_rate / 2,
+                                          max_harmonic, tolerance_hz, self.freq_resolution,
+                                          ptr['harmonic_n'], ptr['harmonic_idx'])
+            return [{'n': n, 'expected_freq': fundamental * n, 'actual_freq': self.freqs[idx],
+                     'db': self.full_spectrum_db[idx]}
+                    for n, idx in zip(*self._harmonic_bins[:, :count].tolist())]
+
         harmonics = []
         for n in range(1, max_harmonic + 1):
             target_freq = fundamental * n
@@ -161,6 +1034,8 @@ class SpectrumAnalyzer:
         """Start recording peaks for sweep analysis"""
         self.recording = True
         self.recorded_peaks = []
+        self.recorded_audio = []
+        self.recorded_samples = 0
         self.start_time = time.time()
 
     def stop_recording(self):
@@ -168,111 +1043,237 @@ class SpectrumAnalyzer:
         self.recording = False
         return self.recorded_peaks
 
+    def get_recorded_audio(self):
+        """Raw samples of the last recording (empty unless keep_audio)"""
+        if not self.recorded_audio:
+            return np.zeros(0, dtype=np.float32)
+        return np.concatenate(self.recorded_audio)
+
     def get_spectrum_bar(self, width=60):
         """Generate ASCII spectrum bar for terminal display"""
         if self.smoothed_spectrum is None:
             return ""
+        return spectrum_bar(self.smoothed_spectrum, width)
 
-        # Normalize to 0-1 range
-        spec = self.smoothed_spectrum
-        spec_norm = (spec - spec.min()) / (spec.max() - spec.min() + 1e-10)
 
-        # Resample to width
-        indices = np.linspace(0, len(spec_norm) - 1, width).astype(int)
-        bars = spec_norm[indices]
+def health_warnings(clip_hold, dc_offset):
+    """Input-health warning words ('' when fine)"""
+    warnings = []
+    if clip_hold:
+        warnings.append("CLIP")
+    if abs(dc_offset) > DC_WARN:
+        warnings.append(f"DC {dc_offset:+.2f}")
+    return " ".join(warnings)
 
-        # Generate bar characters
-        bar_chars = " ▁▂▃▄▅▆▇█"
-        result = ""
-        for b in bars:
-            idx = min(int(b * (len(bar_chars) - 1)), len(bar_chars) - 1)
-            result += bar_chars[idx]
 
-        return result
+def spectrum_bar(spec, width=60):
+    """One-line ASCII spectrum, normalized to its own min/max"""
+    # Normalize to 0-1 range
+    spec_norm = (spec - spec.min()) / (spec.max() - spec.min() + 1e-10)
 
+    # Resample to width
+    indices = np.linspace(0, len(spec_norm) - 1, width).astype(int)
+    bars = spec_norm[indices]
 
-def detect_tones(peaks, threshold_db=TONE_THRESHOLD_DB, min_duration=MIN_TONE_DURATION):
-    """Detect individual tones from recorded peaks using dB threshold.
+    # Generate bar characters
+    bar_chars = " ▁▂▃▄▅▆▇█"
+    result = ""
+    for b in bars:
+        idx = min(int(b * (len(bar_chars) - 1)), len(bar_chars) - 1)
+        result += bar_chars[idx]
+
+    return result
+
+
+def _summarize_tone(tone_start, tone_end, tone_samples, harmonic_acc):
+    """Build tone dict from collected samples and running harmonic sums"""
+    freqs = [s[1] for s in tone_samples]
+    dbs = [s[2] for s in tone_samples]
+    infos = [s[3] for s in tone_samples]
+    sones = [i['sones'] for i in infos if i.get('sones') is not None]
+    clipped_blocks = sum(1 for i in infos if i.get('clipped'))
+    dc = np.mean([i['dc'] for i in infos]) if infos and 'dc' in infos[0] else 0.0
+    flags = []
+    if clipped_blocks:
+        flags.append('CLIP')
+    if abs(dc) > DC_WARN:
+        flags.append('DC')
+    return {
+        'start': tone_start,
+        'start_sample': infos[0].get('sample') if infos else None,
+        'end': tone_end,
+        'duration': tone_end - tone_start,
+        'avg_freq': np.median(freqs),
+        'max_db': np.max(dbs),
+        'avg_db': np.mean(dbs),
+        'samples': len(tone_samples),
+        'harmonics': {n: db_sum / count for n, (db_sum, count) in harmonic_acc.items()},
+        'sones': np.median(sones) if sones else None,
+        'clipped_blocks': clipped_blocks,
+        'dc_offset': dc,
+        'flags': flags
+    }
 
-    Returns list of tones: [(start_time, end_time, avg_freq, max_db, samples), ...]
+
+def _accumulate_harmonics(harmonic_acc, harmonics):
+    """Add one block's harmonics to running per-harmonic dB sums"""
+    for h in harmonics:
+        db_sum, count = harmonic_acc.get(h['n'], (0.0, 0))
+        harmonic_acc[h['n']] = (db_sum + h['db'], count + 1)
+
+
+class ToneSegmenter:
+    """Streaming tone segmentation: feed peak entries, get tones as they close.
+
+    Entries are process_audio() peak tuples (t, freq, db[, harmonics[, info]]).
+    A tone opens when db rises above threshold_db and closes on the first
+    entry at or below it; push() returns the closed tone dict (see
+    _summarize_tone) or None. Tones shorter than min_duration or with fewer
+    than min_samples entries are dropped. threshold_db may be changed
+    between pushes (adaptive thresholds).
     """
-    if not peaks:
-        return []
 
-    tones = []
-    in_tone = False
-    tone_start = 0
-    tone_samples = []
+    def __init__(self, threshold_db=TONE_THRESHOLD_DB, min_duration=MIN_TONE_DURATION, min_samples=3):
+        self.threshold_db = threshold_db
+        self.min_duration = min_duration
+        self.min_samples = min_samples
+        self.in_tone = False
+        self.tone_start = 0
+        self.tone_samples = []
+        self.harmonic_acc = {}
 
-    for entry in peaks:
-        if len(entry) == 4:
-            t, freq, db, harmonics = entry
-        else:
-            t, freq, db = entry
-            harmonics = []
-
-        if not in_tone and db > threshold_db:
-            # Tone started
-            in_tone = True
-            tone_start = t
-            tone_samples = [(t, freq, db, harmonics)]
-        elif in_tone and db > threshold_db:
-            # Tone continues
-            tone_samples.append((t, freq, db, harmonics))
-        elif in_tone and db <= threshold_db:
+    def push(self, entry):
+        t, freq, db = entry[:3]
+        harmonics = entry[3] if len(entry) > 3 else []
+        info = entry[4] if len(entry) > 4 else {}
+
+        if db > self.threshold_db:
+            if not self.in_tone:
+                # Tone started
+                self.in_tone = True
+                self.tone_start = t
+                self.tone_samples = []
+                self.harmonic_acc = {}
+            self.tone_samples.append((t, freq, db, info))
+            _accumulate_harmonics(self.harmonic_acc, harmonics)
+            return None
+
+        if self.in_tone:
             # Tone ended
-            in_tone = False
-            duration = t - tone_start
-            if duration >= min_duration and len(tone_samples) >= 3:
-                freqs = [s[1] for s in tone_samples]
-                dbs = [s[2] for s in tone_samples]
-                all_harmonics = [s[3] for s in tone_samples if s[3]]
-                tones.append({
-                    'start': tone_start,
-                    'end': t,
-                    'duration': duration,
-                    'avg_freq': np.median(freqs),
-                    'max_db': np.max(dbs),
-                    'avg_db': np.mean(dbs),
-                    'samples': len(tone_samples),
-                    'harmonics': all_harmonics
-                })
-            tone_samples = []
-
-    # Handle tone at end of recording
-    if in_tone and len(tone_samples) >= 3:
-        t = tone_samples[-1][0]
-        duration = t - tone_start
-        if duration >= min_duration:
-            freqs = [s[1] for s in tone_samples]
-            dbs = [s[2] for s in tone_samples]
-            all_harmonics = [s[3] for s in tone_samples if s[3]]
-            tones.append({
-                'start': tone_start,
-                'end': t,
-                'duration': duration,
-                'avg_freq': np.median(freqs),
-                'max_db': np.max(dbs),
-                'avg_db': np.mean(dbs),
-                'samples': len(tone_samples),
-                'harmonics': all_harmonics
-            })
+            self.in_tone = False
+            return self._close(t)
+        return None
+
+    def flush(self):
+        """Close a tone still open at the end of the stream"""
+        if not self.in_tone:
+            return None
+        self.in_tone = False
+        return self._close(self.tone_samples[-1][0])
+
+    def _close(self, t):
+        if t - self.tone_start >= self.min_duration and len(self.tone_samples) >= self.min_samples:
+            return _summarize_tone(self.tone_start, t, self.tone_samples, self.harmonic_acc)
+        return None
+
+
+def _tone_from_range(peaks, start, end):
+    """Tone dict for peaks[start:end], closed by peaks[end] (or at the last entry)"""
+    tone_samples = []
+    harmonic_acc = {}
+    for entry in peaks[start:end]:
+        tone_samples.append((entry[0], entry[1], entry[2], entry[4] if len(entry) > 4 else {}))
+        _accumulate_harmonics(harmonic_acc, entry[3] if len(entry) > 3 else [])
+    close_t = peaks[end][0] if end < len(peaks) else peaks[end - 1][0]
+    return _summarize_tone(peaks[start][0], close_t, tone_samples, harmonic_acc)
+
+
+def detect_tones(peaks, threshold_db=TONE_THRESHOLD_DB, min_duration=MIN_TONE_DURATION, native=None):
+    """Detect individual tones from recorded peaks using dB threshold.
+
+    Returns list of tone dicts (start, end, duration, avg_freq, max_db, avg_db,
+    samples, harmonics, sones, clipped_blocks, dc_offset, flags). Tones
+    with clipped input get 'CLIP' in flags, a large DC offset 'DC'.
+    'harmonics' maps harmonic number to mean dB and is
+    accumulated block by block while the tone is open.
+    native: NativeDSP to segment with (the recording analyzer's .native),
+    else ToneSegmenter.
+    """
+    if native and peaks:
+        t = np.fromiter((p[0] for p in peaks), float, len(peaks))
+        db = np.fromiter((p[2] for p in peaks), float, len(peaks))
+        return [_tone_from_range(peaks, start, end)
+                for start, end in native.segment(t, db, threshold_db, min_duration, 3)]
 
+    segmenter = ToneSegmenter(threshold_db, min_duration)
+    tones = [tone for tone in map(segmenter.push, peaks) if tone]
+    last = segmenter.flush()
+    if last:
+        tones.append(last)
     return tones
 
 
-def analyze_sweep(peaks, tone_duration=1.5, pause_duration=0.5):
+def harmonic_metrics(harmonics, max_db, weights=SCORE_WEIGHTS):
+    """THD, per-harmonic levels and composite audibility score for one tone.
+
+    harmonics: {n: dB}. Levels are reported relative to H1 (dBc).
+    Score = w_fund * max_db + w_harm * (dB the audible harmonics add on top
+    of the fundamental) + w_count * (number of audible harmonics).
+    """
+    h1 = harmonics.get(1)
+    if h1 is None:
+        return {'thd_pct': None, 'levels_dbc': {}, 'audible': 0,
+                'score': weights[0] * max_db}
+
+    levels_dbc = {n: db - h1 for n, db in harmonics.items() if n > 1}
+    ratios = {n: 10 ** (dbc / 10) for n, dbc in levels_dbc.items()}
+    thd_pct = 100 * np.sqrt(sum(ratios.values())) if ratios else 0.0
+
+    audible = [n for n in levels_dbc if harmonics[n] > HARMONIC_AUDIBLE_DB]
+    harmonic_gain_db = 10 * np.log10(1 + sum(ratios[n] for n in audible))
+
+    w_fund, w_harm, w_count = weights
+    score = w_fund * max_db + w_harm * harmonic_gain_db + w_count * len(audible)
+    return {'thd_pct': thd_pct, 'levels_dbc': levels_dbc,
+            'audible': len(audible), 'score': score}
+
+
+def sweep_frequencies(header=None):
+    """Frequencies the firmware sweeps, in order.
+
+    Stock firmware sweeps FREQ_MIN..FREQ_MAX. header: the calib_modes.h
+    the unit's firmware was built with (--sweep-table); its mode table is
+    the sweep then. Raises ValueError if it holds no table.
+    """
+    if not header:
+        return list(range(FREQ_MIN, FREQ_MAX + 1, FREQ_STEP))
+    text = Path(header).read_text()
+    start = text.find('{')
+    end = text.find('}', start)
+    freqs = [int(v) for v in text[start + 1:end].replace(',', ' ').split()] if 0 <= start < end else []
+    if not freqs:
+        raise ValueError(f"{header} has no calib_modes table")
+    return freqs
+
+
+def analyze_sweep(peaks, tone_duration=1.5, pause_duration=0.5, score_weights=SCORE_WEIGHTS, sweep=None,
+                  native=None):
     """Analyze recorded sweep with auto-detection of sweep start.
 
     Detects the intro pattern (2 beeps at ~3000 Hz) and finds sweep start.
     Maps tones to expected frequencies by order, not absolute time.
+    sweep: frequencies the unit swept (default: stock firmware)
+    native: engine for tone segmentation (detect_tones())
     """
     if not peaks:
         return None
 
     # Step 1: Detect all tones
-    tones = detect_tones(peaks)
+    return analyze_tones(detect_tones(peaks, native=native), score_weights, sweep)
 
+
+def analyze_tones(tones, score_weights=SCORE_WEIGHTS, sweep=None):
+    """Map detected tones (detect_tones() or a recovered tone log) to sweep frequencies"""
     if len(tones) < 3:
         print(f"  ⚠ Only {len(tones)} tones detected, need at least 3")
         return None
@@ -307,7 +1308,8 @@ def analyze_sweep(peaks, tone_duration=1.5, pause_duration=0.5):
 
     # Step 3: Map sweep tones to expected frequencies by order
     sweep_tones = tones[sweep_start_idx:]
-    num_expected = int((FREQ_MAX - FREQ_MIN) / FREQ_STEP) + 1
+    sweep_freqs = sweep or sweep_frequencies()
+    num_expected = len(sweep_freqs)
 
     print(f"  📊 Mapping {len(sweep_tones)} sweep tones to {num_expected} expected frequencies")
 
@@ -316,20 +1318,9 @@ def analyze_sweep(peaks, tone_duration=1.5, pause_duration=0.5):
         if i >= num_expected:
             break  # Beyond one sweep cycle
 
-        expected_freq = FREQ_MIN + i * FREQ_STEP
-
-        # Aggregate harmonics
-        harmonic_summary = {}
-        for h_list in tone['harmonics']:
-            for h in h_list:
-                n = h['n']
-                if n not in harmonic_summary:
-                    harmonic_summary[n] = []
-                harmonic_summary[n].append(h['db'])
+        expected_freq = sweep_freqs[i]
 
-        harmonics_avg = {}
-        for n, db_list in harmonic_summary.items():
-            harmonics_avg[n] = np.mean(db_list)
+        metrics = harmonic_metrics(tone['harmonics'], tone['max_db'], score_weights)
 
         results.append({
             'expected_freq': expected_freq,
@@ -338,13 +1329,27 @@ def analyze_sweep(peaks, tone_duration=1.5, pause_duration=0.5):
             'detected_freq': tone['avg_freq'],
             'samples': tone['samples'],
             'duration': tone['duration'],
-            'harmonics': harmonics_avg
+            'harmonics': tone['harmonics'],
+            'thd_pct': metrics['thd_pct'],
+            'harmonic_dbc': metrics['levels_dbc'],
+            'audible_harmonics': metrics['audible'],
+            'score': metrics['score'],
+            'sones': tone.get('sones'),
+            'phons': phon_from_sone(tone['sones']) if tone.get('sones') is not None else None,
+            'flags': tone.get('flags', [])
         })
 
     return results
 
 
-def print_results(results, output_file=None):
+RANK_KEYS = {
+    'score': lambda x: x.get('score', x['max_db']),
+    'db': lambda x: x['max_db'],
+    'sones': lambda x: x.get('sones') or 0.0,
+}
+
+
+def print_results(results, output_file=None, rank_by='score'):
     """Print and optionally save sweep analysis results"""
     if not results:
         print("\n❌ No valid data recorded. Make sure buzzer is running during recording.")
@@ -354,44 +1359,67 @@ def print_results(results, output_file=None):
     print("BUZZER SWEEP ANALYSIS RESULTS")
     print("=" * 65)
 
-    # Find best frequency
-    best = max(results, key=lambda x: x['max_db'])
+    # Find best frequency (composite audibility score by default)
+    score_of = RANK_KEYS['score']
+    rank_of = RANK_KEYS[rank_by]
+    best = max(results, key=rank_of)
 
     print(f"\n🏆 BEST FREQUENCY: {best['expected_freq']:.0f} Hz")
     print(f"   Max dB: {best['max_db']:.1f} dB")
+    print(f"   Score: {score_of(best):.1f}")
+    if best.get('sones') is not None:
+        print(f"   Loudness: {best['sones']:.1f} sone ({best['phons']:.0f} phon)")
     print(f"   Detected at: {best['detected_freq']:.0f} Hz")
 
-    print("\n📊 All frequencies ranked by loudness:")
-    print("-" * 75)
-    print(f"{'Freq (Hz)':>10} {'Max dB':>10} {'Avg dB':>10} {'Detected':>12} {'Δ':>6} {'Samples':>8}")
-    print("-" * 75)
+    print(f"\n📊 All frequencies ranked by {rank_by}:")
+    print("-" * 106)
+    print(f"{'Freq (Hz)':>10} {'Max dB':>10} {'Avg dB':>10} {'Detected':>12} {'Δ':>6} {'Samples':>8}"
+          f" {'THD %':>7} {'Score':>7} {'Sone':>7} {'Phon':>7}")
+    print("-" * 106)
 
-    # Sort by max_db descending
-    for r in sorted(results, key=lambda x: x['max_db'], reverse=True):
+    for r in sorted(results, key=rank_of, reverse=True):
         marker = " 🔊" if r == best else ""
+        if r.get('flags'):
+            marker += " ⚠" + ",".join(r['flags'])
         delta = abs(r['detected_freq'] - r['expected_freq'])
         delta_str = f"{delta:+.0f}" if delta < 100 else "!!!"
+        thd_str = f"{r['thd_pct']:.0f}" if r.get('thd_pct') is not None else "-"
+        sone_str = f"{r['sones']:.1f}" if r.get('sones') is not None else "-"
+        phon_str = f"{r['phons']:.0f}" if r.get('phons') is not None else "-"
         print(f"{r['expected_freq']:>10.0f} {r['max_db']:>10.1f} {r['avg_db']:>10.1f} "
-              f"{r['detected_freq']:>12.0f} {delta_str:>6} {r['samples']:>8}{marker}")
+              f"{r['detected_freq']:>12.0f} {delta_str:>6} {r['samples']:>8}"
+              f" {thd_str:>7} {score_of(r):>7.1f} {sone_str:>7} {phon_str:>7}{marker}")
 
-    print("-" * 75)
+    print("-" * 106)
 
     # Harmonics analysis
     print("\n🎵 Harmonics Analysis (Top 5 frequencies):")
     print("-" * 65)
-    top5 = sorted(results, key=lambda x: x['max_db'], reverse=True)[:5]
+    top5 = sorted(results, key=rank_of, reverse=True)[:5]
     for r in top5:
         h = r.get('harmonics', {})
         if h:
-            h_str = "  ".join(f"H{n}:{db:.0f}dB" for n, db in sorted(h.items()) if n > 1)
+            dbc = r.get('harmonic_dbc', {})
+            h_str = "  ".join(f"H{n}:{db:.0f}dB({dbc[n]:+.0f}c)" if n in dbc else f"H{n}:{db:.0f}dB"
+                              for n, db in sorted(h.items()) if n > 1)
             if h_str:
-                print(f"  {r['expected_freq']:4.0f} Hz: {h_str}")
+                thd = r.get('thd_pct')
+                thd_str = f"  THD {thd:.0f}%" if thd is not None else ""
+                print(f"  {r['expected_freq']:4.0f} Hz: {h_str}{thd_str}")
             else:
                 print(f"  {r['expected_freq']:4.0f} Hz: (no harmonics detected)")
         else:
             print(f"  {r['expected_freq']:4.0f} Hz: (no harmonics data)")
 
     # Recommendations
+    flagged = [r for r in results if r.get('flags')]
+    if flagged:
+        print(f"\n⚠ Input problems on {len(flagged)} tone(s): "
+              + ", ".join(f"{r['expected_freq']:.0f} Hz ({','.join(r['flags'])})" for r in flagged))
+        if any('CLIP' in r['flags'] for r in flagged):
+            print("   Clipping inflates harmonics and flattens the fundamental -"
+                  " move the buzzer away or lower input gain, then re-run")
+
     print("\n💡 Recommendations:")
 
     # Top 3 frequencies
@@ -416,7 +1444,7 @@ def print_results(results, output_file=None):
     best_h_count = 0
     for r in results:
         h = r.get('harmonics', {})
-        h_count = sum(1 for n, db in h.items() if n > 1 and db > -50)
+        h_count = sum(1 for n, db in h.items() if n > 1 and db > HARMONIC_AUDIBLE_DB)
         if h_count > best_h_count:
             best_h_count = h_count
             best_harmonics = r
@@ -440,15 +1468,22 @@ def print_results(results, output_file=None):
                 'detected_freq': r['detected_freq'],
                 'delta_freq': abs(r['detected_freq'] - r['expected_freq']),
                 'samples': r['samples'],
-                'duration': r.get('duration', 0)
+                'duration': r.get('duration', 0),
+                'thd_pct': r.get('thd_pct'),
+                'audible_harmonics': r.get('audible_harmonics', 0),
+                'score': r.get('score'),
+                'sones': r.get('sones'),
+                'phons': r.get('phons'),
+                'flags': ' '.join(r.get('flags', []))
             }
             # Add harmonics columns
-            for n in range(2, 6):
+            for n in range(1, 6):
                 row[f'H{n}_db'] = r.get('harmonics', {}).get(n, None)
             csv_results.append(row)
 
         fieldnames = ['expected_freq', 'max_db', 'avg_db', 'detected_freq', 'delta_freq',
-                      'samples', 'duration', 'H2_db', 'H3_db', 'H4_db', 'H5_db']
+                      'samples', 'duration', 'H1_db', 'H2_db', 'H3_db', 'H4_db', 'H5_db',
+                      'thd_pct', 'audible_harmonics', 'score', 'sones', 'phons', 'flags']
         with open(output_file, 'w', newline='') as f:
             writer = csv.DictWriter(f, fieldnames=fieldnames)
             writer.writeheader()
@@ -456,111 +1491,3148 @@ def print_results(results, output_file=None):
         print(f"\n📁 Results saved to: {output_file}")
 
 
-def live_monitor(analyzer, duration=None, device=None):
-    """Live spectrum monitoring with terminal display"""
-    print("\n🎤 Live Spectrum Monitor")
-    print("   Range: 2400-4500 Hz | Press Ctrl+C to stop")
-    print("-" * 70)
-
-    running = True
-
-    def signal_handler(sig, frame):
-        nonlocal running
-        running = False
+def _lorentzian_db(f, params, n_modes):
+    """Sum of Lorentzian modes plus floor, in dB.
 
-    signal.signal(signal.SIGINT, signal_handler)
+    params = [floor_log, (center, gain_log, q_log) * n_modes]; gains and Q
+    are log10 so they stay positive during the fit.
+    """
+    power = np.full_like(f, 10 ** params[0], dtype=float)
+    for k in range(n_modes):
+        center, gain_log, q_log = params[1 + 3 * k:4 + 3 * k]
+        half_bw = center / (2 * 10 ** q_log)
+        power += 10 ** gain_log / (1 + ((f - center) / half_bw) ** 2)
+    return 10 * np.log10(power)
 
-    start_time = time.time()
 
-    def audio_callback(indata, frames, time_info, status):
-        if status:
-            pass  # Ignore overflow warnings
-        analyzer.process_audio(indata)
+def _levenberg_marquardt(model, p0, y, free, max_iter=200):
+    """Minimal Levenberg-Marquardt least squares (no SciPy dependency).
 
-    with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
-                        blocksize=BLOCK_SIZE, callback=audio_callback,
-                        device=device):
-        while running:
-            if duration and (time.time() - start_time) > duration:
+    Only parameters where free is True are adjusted. Returns (params,
+    covariance of free params, residual std).
+    """
+    p = np.array(p0, dtype=float)
+    idx = np.flatnonzero(free)
+    lam = 1e-2
+    r = model(p) - y
+    cost = r @ r
+    J = None
+    for _ in range(max_iter):
+        J = np.empty((len(y), len(idx)))
+        for j, i in enumerate(idx):
+            step = 1e-6 * max(abs(p[i]), 1.0)
+            dp = p.copy()
+            dp[i] += step
+            J[:, j] = (model(dp) - y - r) / step
+        A = J.T @ J
+        g = J.T @ r
+        try:
+            delta = np.linalg.solve(A + lam * np.diag(np.diag(A) + 1e-12), -g)
+        except np.linalg.LinAlgError:
+            break
+        p_new = p.copy()
+        p_new[idx] += delta
+        r_new = model(p_new) - y
+        cost_new = r_new @ r_new
+        if cost_new < cost:
+            converged = cost - cost_new < 1e-10 * (cost + 1e-12)
+            p, r, cost = p_new, r_new, cost_new
+            lam = max(lam / 10, 1e-9)
+            if converged:
+                break
+        else:
+            lam *= 10
+            if lam > 1e9:
                 break
 
-            # Clear line and print spectrum
-            bar = analyzer.get_spectrum_bar(40)
-            freq_str = f"{analyzer.peak_freq:4.0f} Hz"
-            db_str = f"{analyzer.peak_db:5.1f} dB"
-
-            # Get harmonics info
-            harmonics = analyzer.find_harmonics(analyzer.peak_freq)
-            h_str = ""
-            if harmonics and len(harmonics) > 1:
-                h_count = sum(1 for h in harmonics if h['n'] > 1 and h['db'] > -50)
-                if h_count > 0:
-                    h_str = f" H:{h_count}"
-
-            # Color coding for terminal (ANSI)
-            if analyzer.peak_db > -20:
-                color = "\033[92m"  # Green - loud
-            elif analyzer.peak_db > -35:
-                color = "\033[93m"  # Yellow - medium
-            else:
-                color = "\033[91m"  # Red - quiet
-            reset = "\033[0m"
+    dof = len(y) - len(idx)
+    if dof <= 0:
+        # No residual left to estimate the errors from (fit_modes() never gets here)
+        return p, np.full((len(idx), len(idx)), np.inf), np.inf
+    sigma = np.sqrt(cost / dof)
+    try:
+        cov = np.linalg.pinv(J.T @ J) * sigma ** 2
+    except (np.linalg.LinAlgError, AttributeError):
+        cov = np.full((len(idx), len(idx)), np.inf)
+    return p, cov, sigma
 
-            print(f"\r{color}Peak: {freq_str} | {db_str}{h_str}{reset} | [{bar}]", end="", flush=True)
 
-            time.sleep(0.1)
+def spectral_mode_centers(peaks, band_freqs, min_prominence_db=10, min_spacing_hz=40):
+    """Mode centers from the envelope of all recorded buzzer-band spectra.
 
-    print("\n")
+    The piezo only radiates at its modes, so the per-bin maximum over the
+    recording has one peak per mode that was excited. Peaks are refined
+    with parabolic interpolation.
+    """
+    spectra = [e[4]['band_db'] for e in peaks if len(e) > 4 and 'band_db' in e[4]]
+    if not spectra:
+        return []
+    env = np.max(spectra, axis=0)
+    floor = np.median(env)
+    resolution = band_freqs[1] - band_freqs[0]
 
+    centers = []
+    for i in np.argsort(env)[::-1]:
+        if i == 0 or i == len(env) - 1 or env[i] < floor + min_prominence_db:
+            continue
+        if env[i] < env[i - 1] or env[i] < env[i + 1]:
+            continue
+        a, b, c = env[i - 1], env[i], env[i + 1]
+        denom = a - 2 * b + c
+        center = band_freqs[i] + (0.5 * (a - c) / denom if denom else 0) * resolution
+        if all(abs(center - c0) >= min_spacing_hz for c0 in centers):
+            centers.append(center)
+    return sorted(centers)
 
-def record_sweep(analyzer, sweep_duration=50, device=None):
-    """Record a complete calibration sweep"""
-    print("\n🔴 RECORDING MODE")
-    print("=" * 65)
-    print(f"   Expected sweep duration: ~{sweep_duration} seconds")
-    print("   Range: 2400-4500 Hz, step 100 Hz")
-    print("\n   1. Connect buzzer (don't power on yet)")
-    print("   2. Short PB1 to GND for calibration mode")
-    print("   3. Power on buzzer")
-    print("   4. Press Enter when ready to start recording...")
 
-    input()
+def fit_modes(results, centers=None):
+    """Fit a multi-Lorentzian response to sweep results.
 
-    print("\n🎤 Recording... Press Ctrl+C when sweep completes")
-    print("-" * 65)
+    results: analyze_sweep() output; each tone's drive frequency
+    (expected_freq) and level (max_db) is one data point. centers: initial
+    mode centers from spectral_mode_centers(), completed with clusters of
+    detected frequencies (PIEZO_MODES if neither gives two). Each mode
+    costs a gain and a Q on top of the shared floor, so only the strongest
+    (len(results) - 2) // 2 candidates are fitted, which leaves at least one
+    degree of freedom for the confidence intervals: 2 modes from a stock
+    7-tone sweep, all of them from a fine sweep. Centers are held fixed
+    unless there are enough points to fit them too.
 
-    analyzer.start_recording()
-    running = True
+    Returns list of modes sorted by frequency with center, Q, gain
+    (dB relative to the loudest mode) and 95% confidence intervals; each
+    also records the number of sweep points and candidate modes, which
+    print_modes() reports when candidates were left out.
+    """
+    if not results or len(results) < 3:
+        return []
 
-    def signal_handler(sig, frame):
-        nonlocal running
-        running = False
+    f = np.array([r['expected_freq'] for r in results], dtype=float)
+    y = np.array([r['max_db'] for r in results], dtype=float)
 
-    old_handler = signal.signal(signal.SIGINT, signal_handler)
+    # Modes the piezo locked onto but too weak to stand out in the spectra.
+    # Coarse sweeps only: with fine steps every drive frequency is detected
+    # as itself and would fake a mode every 40 Hz
+    centers = list(centers or [])
+    clusters = []
+    order = np.argsort(f)
+    if np.median(np.diff(f[order])) >= 40:
+        for d in sorted(r['detected_freq'] for r in results):
+            if not clusters or d - clusters[-1] > 40:
+                clusters.append(d)
+    else:
+        # Fine sweeps resolve the response itself: its local maxima are modes
+        fs, ys = f[order], y[order]
+        clusters = [fs[i] for i in range(1, len(fs) - 1) if ys[i] >= ys[i - 1] and ys[i] > ys[i + 1]]
+    centers = sorted(centers + [c for c in clusters if all(abs(c - c0) > 40 for c0 in centers)])
+    if len(centers) < 2:
+        centers = PIEZO_MODES
+    centers = [c for c in centers if f.min() - FREQ_STEP <= c <= f.max() + FREQ_STEP]
+    max_modes = (len(f) - 2) // 2
+    if not centers or max_modes < 1:
+        return []
+    candidates = len(centers)
+    if len(centers) > max_modes:
+        strength = [y[np.argmin(np.abs(f - c))] for c in centers]
+        centers = [centers[i] for i in sorted(np.argsort(strength)[::-1][:max_modes])]
+    n_modes = len(centers)
 
-    def audio_callback(indata, frames, time_info, status):
-        analyzer.process_audio(indata)
+    p0 = [(y.min() - 10) / 10]
+    for c in centers:
+        near = np.argmin(np.abs(f - c))
+        p0 += [c, y[near] / 10, np.log10(30.0)]
+    free = np.ones(len(p0), dtype=bool)
+    fix_centers = len(f) < 3 * n_modes + 2  # Free centers need a point left over as well
+    if fix_centers:
+        free[1::3] = False
 
-    try:
-        with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
-                            blocksize=BLOCK_SIZE, callback=audio_callback,
-                            device=device):
-            start = time.time()
-            while running:
-                elapsed = time.time() - start
-                bar = analyzer.get_spectrum_bar(40)
-                print(f"\r  {elapsed:5.1f}s | Peak: {analyzer.peak_freq:4.0f} Hz "
-                      f"| {analyzer.peak_db:5.1f} dB | [{bar}]", end="", flush=True)
-                time.sleep(0.1)
-    finally:
-        signal.signal(signal.SIGINT, old_handler)
+    # Box bounds keep a poorly constrained mode from running off to Q=inf
+    # or out of the swept range (the model sees the clipped parameters)
+    lo = np.array([-15.0] + [f.min() - FREQ_STEP, -15.0, 0.5] * n_modes)
+    hi = np.array([5.0] + [f.max() + FREQ_STEP, 5.0, 3.5] * n_modes)
+    model = lambda p: _lorentzian_db(f, np.clip(p, lo, hi), n_modes)
+    params, cov, sigma = _levenberg_marquardt(model, p0, y, free)
+    params = np.clip(params, lo, hi)
 
-    print("\n\n⏹ Recording stopped")
+    # Standard errors for every parameter (fixed ones get 0)
+    stderr = np.zeros(len(params))
+    diag = np.diag(cov)
+    stderr[np.flatnonzero(free)] = np.sqrt(np.maximum(diag, 0)) if np.all(np.isfinite(diag)) else np.inf
 
-    peaks = analyzer.stop_recording()
-    print(f"   Recorded {len(peaks)} samples over {peaks[-1][0]:.1f} seconds")
+    gains_db = [10 * params[2 + 3 * k] for k in range(n_modes)]
+    ref_db = max(gains_db)
+    modes = []
+    for k in range(n_modes):
+        c, g_log, q_log = params[1 + 3 * k:4 + 3 * k]
+        c_err, g_err, q_err = stderr[1 + 3 * k:4 + 3 * k] * 1.96
+        modes.append({
+            'center': c,
+            'center_ci': c_err,
+            'q': 10 ** q_log,
+            'q_ci': (10 ** (q_log - q_err), 10 ** (q_log + q_err)),
+            'gain_db': gains_db[k] - ref_db,
+            'gain_ci': 10 * g_err,
+            'center_fixed': fix_centers,
+            'points': len(f),
+            'candidates': candidates,
+        })
+    return sorted(modes, key=lambda m: m['center'])
 
-    return peaks
+
+def print_modes(modes, output_file=None):
+    """Print fitted mode table and optionally save it as CSV"""
+    if not modes:
+        print("\n❌ Mode fit failed: not enough sweep data")
+        return
+
+    print("\n🎯 Fitted resonance modes (95% CI):")
+    print("-" * 65)
+    print(f"{'Mode':>4} {'Center (Hz)':>16} {'Q':>22} {'Gain (dB)':>14}")
+    print("-" * 65)
+    if modes[0].get('candidates', 0) > len(modes):
+        print(f"  ℹ️  {modes[0]['points']} sweep points resolve {len(modes)} of "
+              f"{modes[0]['candidates']} candidate modes")
+    for i, m in enumerate(modes, 1):
+        center = f"{m['center']:.0f}" + (" (fixed)" if m['center_fixed'] else f" ±{m['center_ci']:.0f}")
+        q_lo, q_hi = m['q_ci']
+        q_str = f"{m['q']:.0f} [{q_lo:.0f}-{q_hi:.0f}]" if np.isfinite(q_hi) else f"{m['q']:.0f} [?]"
+        gain = f"{m['gain_db']:+.1f} ±{m['gain_ci']:.1f}"
+        print(f"{i:>4} {center:>16} {q_str:>22} {gain:>14}")
+    print("-" * 65)
+
+    if output_file:
+        import csv
+        with open(output_file, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(['center_hz', 'center_ci_hz', 'q', 'q_ci_low', 'q_ci_high',
+                             'gain_db', 'gain_ci_db'])
+            for m in modes:
+                writer.writerow([f"{m['center']:.1f}", f"{m['center_ci']:.1f}", f"{m['q']:.1f}",
+                                 f"{m['q_ci'][0]:.1f}", f"{m['q_ci'][1]:.1f}",
+                                 f"{m['gain_db']:.2f}", f"{m['gain_ci']:.2f}"])
+        print(f"\n📁 Modes saved to: {output_file}")
+
+
+def write_calib_header(modes, path=CALIB_HEADER, min_gain_db=-12):
+    """Write fitted mode centers as the firmware's calibration sweep table.
+
+    Modes more than min_gain_db below the loudest are left out, so the
+    sweep only visits usable modes, and so are centers outside
+    CALIB_FREQ_MIN..CALIB_FREQ_MAX, which the firmware would save but then
+    replace by DEFAULT_FREQ at boot. Returns False (nothing written) when
+    no mode is left, or when the sweep was too coarse to fit the centers:
+    held at their candidates, they would only repeat drive frequencies.
+    """
+    if any(m['center_fixed'] for m in modes):
+        print(f"❌ Mode centers were not fitted ({modes[0]['points']} sweep points), {path} not written: "
+              f"fit a finer sweep (3 points per mode plus 2)")
+        return False
+    freqs = sorted(int(round(m['center'])) for m in modes if m['gain_db'] >= min_gain_db)
+    rejected = [v for v in freqs if not CALIB_FREQ_MIN <= v <= CALIB_FREQ_MAX]
+    if rejected:
+        print(f"⚠️  Left out of the firmware table (outside {CALIB_FREQ_MIN}-{CALIB_FREQ_MAX} Hz): "
+              f"{', '.join(str(v) for v in rejected)} Hz")
+        freqs = [v for v in freqs if v not in rejected]
+    if not freqs:
+        print(f"❌ No usable mode for the firmware table, {path} not written")
+        return False
+    with open(path, 'w') as f:
+        f.write("/*\n")
+        f.write(f" * Calibration sweep table - generated by buzzer_analyzer.py --fit-modes\n")
+        f.write(f" * {datetime.now().strftime('%Y-%m-%d %H:%M')}, {len(freqs)} modes\n")
+        f.write(" */\n")
+        f.write("#define CALIB_MODE_COUNT %d\n" % len(freqs))
+        f.write("static const uint16_t calib_modes[CALIB_MODE_COUNT] PROGMEM = { %s };\n"
+                % ", ".join(str(v) for v in freqs))
+    print(f"📁 Firmware table written to: {path} ({', '.join(str(v) for v in freqs)} Hz)")
+    print(f"   Analyze sweeps of units flashed with it using --sweep-table {path}")
+    return True
+
+
+def is_results_csv(path):
+    """True for a CSV written by print_results() (by its header, whatever the file name)"""
+    with open(path, newline='') as f:
+        header = f.readline().strip().split(',')
+    return {'expected_freq', 'max_db', 'detected_freq'} <= set(header)
+
+
+def load_results_csv(path):
+    """Load sweep results saved by print_results()"""
+    import csv
+    results = []
+    with open(path, newline='') as f:
+        for row in csv.DictReader(f):
+            results.append({
+                'expected_freq': float(row['expected_freq']),
+                'max_db': float(row['max_db']),
+                'avg_db': float(row['avg_db']),
+                'detected_freq': float(row['detected_freq']),
+                'samples': int(float(row['samples'])),
+                'duration': float(row.get('duration') or 0),
+            })
+            for key in ('score', 'sones'):
+                if row.get(key):
+                    results[-1][key] = float(row[key])
+    return results
+
+
+def analytic_band(segment, sample_rate, center, half_band=ONSET_BAND_HZ):
+    """Band-limited analytic signal of segment around center (FFT method).
+
+    Gaussian passband (sigma = half_band / 2) rather than a brick wall: a
+    brick wall rings for tens of ms before the onset, the Gaussian's time
+    response is ~0.6 ms wide.
+    """
+    # Taper the ends so the segment edges don't wrap around into the onset
+    n = len(segment)
+    taper = min(n // 4, int(0.01 * sample_rate))
+    ramp = 0.5 - 0.5 * np.cos(np.pi * np.arange(taper) / taper)
+    segment = segment.copy()
+    segment[:taper] *= ramp
+    segment[n - taper:] *= ramp[::-1]
+    spectrum = np.fft.fft(segment)
+    freqs = np.fft.fftfreq(n, 1 / sample_rate)
+    gain = np.where(freqs > 0, 2 * np.exp(-0.5 * ((freqs - center) / (half_band / 2)) ** 2), 0.0)
+    return np.fft.ifft(spectrum * gain)
+
+
+def envelope_crossing(env, level, begin=0):
+    """First fractional sample index >= begin where env reaches level"""
+    above = np.flatnonzero(env[begin:] >= level)
+    if not len(above):
+        return None
+    i = begin + above[0]
+    if i == 0:
+        return 0.0
+    frac = (level - env[i - 1]) / (env[i] - env[i - 1] + 1e-20)
+    return i - 1 + frac
+
+
+def rise_points(env, noise, steady, begin=0):
+    """10% and 90% envelope crossings (fractional samples), None if absent"""
+    i10 = envelope_crossing(env, noise + 0.1 * (steady - noise), begin)
+    if i10 is None:
+        return None, None
+    return i10, envelope_crossing(env, noise + 0.9 * (steady - noise), int(i10))
+
+
+def analyze_onset(audio, sample_rate, tone, block_size=BLOCK_SIZE):
+    """Sub-ms onset and settling of one tone from raw audio.
+
+    The block FFT only says the tone started somewhere in the block before
+    its first loud block. Around that point, the analytic-signal envelope
+    gives the onset (10% crossing, interpolated between samples) and
+    rise time (10-90%); instantaneous frequency from the unwrapped phase
+    shows the piezo pulling onto its mode.
+    """
+    start = tone.get('start_sample')
+    if start is None:
+        return None
+    lo = max(0, start - 2 * block_size)
+    hi = min(len(audio), start + block_size + int(0.3 * sample_rate))
+    if hi - lo < block_size * 2:
+        return None
+
+    z = analytic_band(audio[lo:hi].astype(np.float64), sample_rate, tone['avg_freq'])
+    env = np.abs(z)
+    noise = np.median(env[:block_size])
+    edge = int(0.01 * sample_rate)  # skip the tapered edge
+    steady = np.percentile(env, 90)
+    if steady < 4 * noise:
+        return None
+
+    i10, i90 = rise_points(env, noise, steady, edge)
+    if i10 is None:
+        return None
+
+    # Instantaneous frequency, lightly smoothed
+    inst = np.diff(np.unwrap(np.angle(z))) * sample_rate / (2 * np.pi)
+    smooth = max(1, int(ONSET_SMOOTH_MS * sample_rate / 1000))
+    inst = np.convolve(inst, np.ones(smooth) / smooth, mode='same')
+
+    onset = int(i10)
+    final_lo = onset + int(0.1 * sample_rate)
+    final_hi = min(len(inst), onset + int(0.25 * sample_rate))
+    if final_hi - final_lo < smooth:
+        return None
+    final_freq = np.median(inst[final_lo:final_hi])
+
+    # Settled: last excursion beyond tolerance before the steady window
+    off = np.abs(inst[onset:final_lo] - final_freq) > ONSET_SETTLE_HZ
+    settle_ms = (np.flatnonzero(off)[-1] + 1) / sample_rate * 1000 if off.any() else 0.0
+
+    trace = {}
+    for ms in ONSET_TRACE_MS:
+        i = onset + int(ms * sample_rate / 1000)
+        if i < len(inst):
+            trace[ms] = inst[i] - final_freq
+
+    return {
+        'onset_s': (lo + i10) / sample_rate,
+        'rise_ms': (i90 - i10) / sample_rate * 1000 if i90 is not None else None,
+        'settle_ms': settle_ms,
+        'final_freq': final_freq,
+        'trace': trace,
+    }
+
+
+def print_onsets(audio, sample_rate, tones):
+    """Onset/ring-up table per tone and mean ring-up per piezo mode"""
+    print("\n⏱ Onset analysis (analytic signal):")
+    print("-" * 78)
+    print(f"{'Tone':>4} {'Freq':>8} {'Onset (s)':>11} {'Rise ms':>8} {'Settle ms':>10}  "
+          f"Δf after onset (Hz) @ " + "/".join(str(ms) for ms in ONSET_TRACE_MS) + " ms")
+    print("-" * 78)
+
+    per_mode = {}
+    for i, tone in enumerate(tones, 1):
+        o = analyze_onset(audio, sample_rate, tone)
+        if not o:
+            print(f"{i:>4} {tone['avg_freq']:>8.0f}   (no clean onset)")
+            continue
+        rise = f"{o['rise_ms']:.2f}" if o['rise_ms'] is not None else "-"
+        trace = " ".join(f"{o['trace'][ms]:+.0f}" for ms in ONSET_TRACE_MS if ms in o['trace'])
+        print(f"{i:>4} {o['final_freq']:>8.1f} {o['onset_s']:>11.5f} {rise:>8} "
+              f"{o['settle_ms']:>10.2f}  {trace}")
+        mode = min(PIEZO_MODES, key=lambda m: abs(m - o['final_freq']))
+        if o['rise_ms'] is not None:
+            per_mode.setdefault(mode, []).append((o['rise_ms'], o['settle_ms']))
+    print("-" * 78)
+
+    if per_mode:
+        print("\n  Ring-up per mode (mean rise / settle):")
+        for mode in sorted(per_mode):
+            rises, settles = zip(*per_mode[mode])
+            print(f"  {mode:5d} Hz: {np.mean(rises):6.2f} ms / {np.mean(settles):6.2f} ms"
+                  f"  ({len(rises)} tones)")
+
+
+class WavReader:
+    """Memory-mapped WAV file: blocks are converted on demand, never loaded whole.
+
+    Handles PCM 8/16/24/32-bit, 32/64-bit float and WAVE_FORMAT_EXTENSIBLE.
+    Reading a block only touches its pages, so long recordings stream at
+    disk/page-cache speed in constant memory.
+    """
+
+    def __init__(self, path):
+        import struct
+        self.path = str(path)
+        self.fmt = None
+        with open(self.path, 'rb') as f:
+            head = f.read(12)
+            if len(head) < 12 or head[:4] != b'RIFF' or head[8:] != b'WAVE':
+                raise ValueError(f"{path}: not a RIFF/WAVE file")
+            file_size = f.seek(0, 2)
+            pos = 12
+            data_offset = data_size = None
+            while pos + 8 <= file_size:
+                f.seek(pos)
+                chunk_id, size = struct.unpack('<4sI', f.read(8))
+                if chunk_id == b'fmt ':
+                    fmt = f.read(size)
+                    tag, self.channels, self.rate, _, _, bits = struct.unpack('<HHIIHH', fmt[:16])
+                    if tag == 0xFFFE and len(fmt) >= 26:
+                        tag = struct.unpack('<H', fmt[24:26])[0]  # Sub-format GUID starts with the tag
+                    self.fmt = (tag, bits)
+                elif chunk_id == b'data':
+                    # Streams cut short (or size 0xFFFFFFFF) end at the file end
+                    data_offset, data_size = pos + 8, min(size, file_size - pos - 8)
+                    break
+                pos += 8 + size + (size & 1)
+        if self.fmt is None or data_offset is None:
+            raise ValueError(f"{path}: missing fmt or data chunk")
+
+        tag, bits = self.fmt
+        dtypes = {(1, 8): np.uint8, (1, 16): '<i2', (1, 24): np.uint8, (1, 32): '<i4',
+                  (3, 32): '<f4', (3, 64): '<f8'}
+        if (tag, bits) not in dtypes:
+            raise ValueError(f"{path}: unsupported WAV format {tag}, {bits} bit")
+        self.frame_bytes = self.channels * bits // 8
+        self.frames = data_size // self.frame_bytes
+        raw = np.memmap(self.path, dtype=np.uint8, mode='r', offset=data_offset,
+                        shape=(self.frames * self.frame_bytes,))
+        if bits == 24:
+            self._data = raw.reshape(self.frames, self.channels, 3)
+        else:
+            self._data = raw.view(dtypes[(tag, bits)]).reshape(self.frames, self.channels)
+
+    @property
+    def duration(self):
+        return self.frames / self.rate
+
+    def read(self, start=0, count=None):
+        """float32 [frames, channels] from frame start (count=None: to the end)"""
+        end = self.frames if count is None else min(self.frames, start + count)
+        block = self._data[start:end]
+        tag, bits = self.fmt
+        if tag == 3:
+            return block.astype(np.float32)
+        if bits == 8:
+            return (block.astype(np.float32) - 128) / 128
+        if bits == 24:
+            b = block.astype(np.int32)
+            value = b[..., 0] | (b[..., 1] << 8) | (b[..., 2] << 16)
+            value -= (value & 0x800000) << 1
+            return value.astype(np.float32) / 2 ** 23
+        return block.astype(np.float32) / (2 ** (bits - 1))
+
+    def blocks(self, block_frames, pad=False):
+        """Yield consecutive float32 [frames, channels] blocks; pad=True zero-fills the last"""
+        for start in range(0, self.frames, block_frames):
+            block = self.read(start, block_frames)
+            if pad and len(block) < block_frames:
+                block = np.vstack([block, np.zeros((block_frames - len(block), self.channels), np.float32)])
+            yield block
+
+
+def read_wav(path):
+    """Read a whole WAV file. Returns (sample_rate, float32 array [frames, channels])"""
+    wav = WavReader(path)
+    return wav.rate, wav.read()
+
+
+def iter_wav_chunks(path, chunk_frames):
+    """Stream a WAV file as (sample_rate, float32 [frames, channels]) chunks"""
+    wav = WavReader(path)
+    for chunk in wav.blocks(chunk_frames):
+        yield wav.rate, chunk
+
+
+def analyze_wav(analyzer, path):
+    """Feed a WAV file through the analyzer block by block, as fast as possible.
+
+    Runs the same process_audio() path as live capture, with timestamps
+    taken from the sample position instead of the wall clock. Multi-channel
+    files are mixed to mono. The analyzer must be built for the file's
+    rate (WavReader(path).rate). Returns the recorded peaks.
+    """
+    wav = WavReader(path)
+    print(f"\n📂 Analyzing {path}: {wav.duration:.1f} s, {wav.channels} ch, {wav.rate} Hz")
+
+    analyzer.start_recording()
+    block = analyzer.block_size
+    t0 = time.perf_counter()
+    for i, data in enumerate(wav.blocks(block, pad=True)):
+        mono = data[:, 0] if wav.channels == 1 else data.mean(axis=1)
+        analyzer.process_audio(mono, timestamp=(i + 1) * block / wav.rate)
+    peaks = analyzer.stop_recording()
+    took = time.perf_counter() - t0
+    print(f"   {len(peaks)} blocks in {took:.2f} s ({wav.duration / max(took, 1e-9):.0f}x real time)")
+    return peaks
+
+
+class ToneLog:
+    """Crash-safe tone log: tones hit the disk as the segmenter closes them.
+
+    Fed the same peak entries as recorded_peaks, it runs a ToneSegmenter
+    and appends each closed tone as one JSON line. Writing happens on a
+    background thread so the audio callback never waits for the disk;
+    the thread drains everything queued, writes it in one go and fsyncs,
+    at most once per TONE_LOG_SYNC_S. A clean close() appends an 'end'
+    line. load_tone_log() reads partial files (power loss, crash) up to
+    the last complete line.
+    """
+
+    def __init__(self, path, metadata):
+        import json
+        import queue
+        import threading
+        self.path = str(path)
+        self.json = json
+        self.segmenter = ToneSegmenter()
+        self.count = 0
+        self.queue = queue.Queue()
+        self.file = open(self.path, 'w')
+        self.queue.put(dict(metadata, type='header'))
+        self.thread = threading.Thread(target=self._writer, daemon=True)
+        self.thread.start()
+
+    def push(self, entry):
+        """Feed one peak entry; queues the tone it closes, if any"""
+        tone = self.segmenter.push(entry)
+        if tone:
+            self._queue_tone(tone)
+
+    def _queue_tone(self, tone):
+        self.count += 1
+        self.queue.put(dict(tone, type='tone', index=self.count))
+
+    def _writer(self):
+        import os
+        done = False
+        while not done:
+            batch = [self.queue.get()]
+            while not self.queue.empty():
+                batch.append(self.queue.get_nowait())
+            if batch[-1] is None:
+                batch.pop()
+                done = True
+            for record in batch:
+                self.file.write(self.json.dumps(record, default=float) + "\n")
+            self.file.flush()
+            os.fsync(self.file.fileno())
+            if not done:
+                time.sleep(TONE_LOG_SYNC_S)
+
+    def close(self):
+        """Flush the open tone, write the end marker and wait for the disk"""
+        tone = self.segmenter.flush()
+        if tone:
+            self._queue_tone(tone)
+        self.queue.put({'type': 'end', 'tones': self.count})
+        self.queue.put(None)
+        self.thread.join()
+        self.file.close()
+
+
+def load_tone_log(path):
+    """Read a tone log, tolerating a torn last line.
+
+    Returns (metadata, tones, complete); complete is False when the
+    recording never reached a clean close().
+    """
+    import json
+    metadata, tones, complete = {}, [], False
+    with open(path) as f:
+        for line in f:
+            try:
+                record = json.loads(line)
+            except ValueError:
+                break   # Partially written line: everything before it is intact
+            kind = record.pop('type', None)
+            if kind == 'header':
+                metadata = record
+            elif kind == 'tone':
+                record['harmonics'] = {int(n): db for n, db in record.get('harmonics', {}).items()}
+                tones.append(record)
+            elif kind == 'end':
+                complete = True
+    return metadata, tones, complete
+
+
+def recover_tone_log(path, args):
+    """Rebuild sweep results from a (possibly partial) tone log"""
+    metadata, tones, complete = load_tone_log(path)
+    state = "complete" if complete else "INCOMPLETE - recording was interrupted"
+    print(f"\n💾 {path}: {len(tones)} tones, {state}")
+    if metadata:
+        print(f"   Recorded {metadata.get('created', '?')} from {metadata.get('source', '?')}")
+    results = analyze_tones(tones, args.score_weights, args.sweep or metadata.get('sweep'))
+    output_file = args.output or str(Path(path).with_name(Path(path).name.replace('.tones.jsonl', '') +
+                                                         '_recovered.csv'))
+    print_results(results, output_file, rank_by=args.rank_by)
+
+
+class RecordingWriter:
+    """Writes per-block peaks and buzzer-band spectra to a .bzr file.
+
+    Layout: header ('BZRC', version, JSON metadata), then chunks of
+    REC_CHUNK_BLOCKS blocks. Each chunk starts with a small table of its
+    time range and columns (name, codec, dtype, width, byte size), followed
+    by the zlib-compressed columns, so a reader can seek straight to the
+    columns and time span it needs. Floats are byte-shuffled before
+    compression; spectra are quantized to REC_SPECTRUM_STEP_DB and
+    delta-coded along time, which is where most of the size goes. A footer
+    indexes the chunks; a file without one (interrupted recording) is
+    still read by scanning the chunk headers. append() runs in the audio
+    callback, so full chunks are compressed and written by a background
+    thread, as in ToneLog.
+    """
+
+    VERSION = 1
+
+    def __init__(self, path, metadata):
+        import json
+        import queue
+        import threading
+        self.path = str(path)
+        self.file = open(self.path, 'wb')
+        meta = json.dumps(metadata, default=float).encode()
+        self.file.write(b'BZRC' + np.uint16(self.VERSION).tobytes() + np.uint32(len(meta)).tobytes() + meta)
+        self.rows = []
+        self.index = []   # Written by the writer thread only, read after close() joins it
+        self.blocks = 0
+        self.queue = queue.Queue()
+        self.thread = threading.Thread(target=self._writer, daemon=True)
+        self.thread.start()
+
+    def append(self, entry):
+        """Add one process_audio() peak tuple (t, freq, db, harmonics, info)"""
+        t, freq, db, harmonics, info = entry
+        harm_db = np.full(REC_HARMONICS, np.nan, dtype=np.float32)
+        harm_freq = np.full(REC_HARMONICS, np.nan, dtype=np.float32)
+        for h in harmonics:
+            if h['n'] <= REC_HARMONICS:
+                harm_db[h['n'] - 1] = h['db']
+                harm_freq[h['n'] - 1] = h['actual_freq']
+        self.rows.append((t, info.get('sample', 0), freq, db, info.get('sones') or 0.0,
+                          info.get('rms_db', 0.0), info.get('dc', 0.0), info.get('clipped', 0),
+                          harm_db, harm_freq, info['band_db']))
+        if len(self.rows) >= REC_CHUNK_BLOCKS:
+            self.queue.put(self.rows)
+            self.rows = []
+
+    def _writer(self):
+        while True:
+            rows = self.queue.get()
+            if rows is None:
+                return
+            self._write_chunk(rows)
+
+    def _write_chunk(self, rows):
+        import zlib
+        cols = list(zip(*rows))
+        columns = {
+            'time': np.array(cols[0], dtype='<f8'),
+            'sample': np.array(cols[1], dtype='<i8'),
+            'peak_freq': np.array(cols[2], dtype='<f4'),
+            'peak_db': np.array(cols[3], dtype='<f4'),
+            'sones': np.array(cols[4], dtype='<f4'),
+            'rms_db': np.array(cols[5], dtype='<f4'),
+            'dc': np.array(cols[6], dtype='<f4'),
+            'clipped': np.array(cols[7], dtype='<u4'),
+            'harm_db': np.array(cols[8], dtype='<f4'),
+            'harm_freq': np.array(cols[9], dtype='<f4'),
+            'band_db': np.array(cols[10], dtype=np.float32),
+        }
+
+        table = b''
+        payload = b''
+        for name, data in columns.items():
+            if name == 'band_db':
+                codec = 2
+                q = np.round(data / REC_SPECTRUM_STEP_DB).astype(np.int32)
+                q[1:] -= q[:-1].copy()
+                data = np.clip(q, -32768, 32767).astype('<i2') if np.abs(q).max() < 32768 else q.astype('<i4')
+            else:
+                codec = 1
+            width = data.shape[1] if data.ndim > 1 else 1
+            raw = data.tobytes()
+            # Byte shuffle: group the n-th byte of every value together
+            raw = np.frombuffer(raw, np.uint8).reshape(-1, data.itemsize).T.tobytes()
+            packed = zlib.compress(raw, 6)
+            dtype = data.dtype.str.encode()
+            table += (bytes([len(name)]) + name.encode() + bytes([codec, len(dtype)]) + dtype +
+                      np.array([width, len(packed)], dtype='<u4').tobytes())
+            payload += packed
+
+        offset = self.file.tell()
+        t0, t1 = float(columns['time'][0]), float(columns['time'][-1])
+        self.file.write(b'BZCK' + np.array([len(rows), len(columns)], dtype='<u4').tobytes() +
+                        np.array([t0, t1], dtype='<f8').tobytes() +
+                        np.uint32(len(table)).tobytes() + table + payload)
+        self.index.append((offset, t0, t1, len(rows)))
+        self.blocks += len(rows)
+
+    def close(self):
+        """Write the last partial chunk and the footer, after the writer has caught up"""
+        if self.rows:
+            self.queue.put(self.rows)
+            self.rows = []
+        self.queue.put(None)
+        self.thread.join()
+        footer_offset = self.file.tell()
+        self.file.write(b'BZIX' + np.uint32(len(self.index)).tobytes())
+        for offset, t0, t1, n in self.index:
+            self.file.write(np.uint64(offset).tobytes() + np.array([t0, t1], dtype='<f8').tobytes() +
+                            np.uint32(n).tobytes())
+        self.file.write(np.uint64(footer_offset).tobytes() + b'BZEN')
+        self.file.close()
+        print(f"📦 Recording saved to: {self.path} ({self.blocks} blocks, "
+              f"{Path(self.path).stat().st_size / 1024:.0f} KiB)")
+
+
+class RecordingReader:
+    """Reads .bzr recordings written by RecordingWriter.
+
+    read() decompresses only the chunks overlapping the requested time
+    span and only the requested columns.
+    """
+
+    def __init__(self, path):
+        import json
+        self.path = str(path)
+        with open(self.path, 'rb') as f:
+            data = f.read(10)
+            if data[:4] != b'BZRC':
+                raise ValueError(f"{path}: not a .bzr recording")
+            meta_len = int(np.frombuffer(data[6:10], '<u4')[0])
+            self.metadata = json.loads(f.read(meta_len))
+            self.chunks = self._load_index(f) or self._scan(f, 10 + meta_len)
+        self.blocks = sum(c[3] for c in self.chunks)
+
+    def _load_index(self, f):
+        size = f.seek(0, 2)
+        if size < 12:
+            return None
+        f.seek(size - 12)
+        tail = f.read(12)
+        if tail[8:] != b'BZEN':
+            return None
+        f.seek(int(np.frombuffer(tail[:8], '<u8')[0]))
+        head = f.read(8)
+        if head[:4] != b'BZIX':
+            return None
+        n = int(np.frombuffer(head[4:], '<u4')[0])
+        entries = np.frombuffer(f.read(28 * n), dtype=[('o', '<u8'), ('t0', '<f8'), ('t1', '<f8'), ('n', '<u4')])
+        return [(int(e['o']), float(e['t0']), float(e['t1']), int(e['n'])) for e in entries]
+
+    def _scan(self, f, pos):
+        """Rebuild the chunk index of a file without footer (interrupted recording)"""
+        chunks = []
+        size = f.seek(0, 2)
+        while pos + 28 <= size:
+            f.seek(pos)
+            head = f.read(28)
+            if head[:4] != b'BZCK':
+                break
+            n, _ = np.frombuffer(head[4:12], '<u4')
+            t0, t1 = np.frombuffer(head[12:28], '<f8')
+            columns, body = self._columns(f)
+            end = f.tell() + body
+            if end > size:
+                break       # Chunk cut off mid-write
+            chunks.append((pos, float(t0), float(t1), int(n)))
+            pos = end
+        return chunks
+
+    @staticmethod
+    def _columns(f):
+        """Parse a chunk's column table at the current position (just after the fixed header)"""
+        table_len = int(np.frombuffer(f.read(4), '<u4')[0])
+        table = f.read(table_len)
+        columns, i, offset = {}, 0, 0
+        while i < len(table):
+            name_len = table[i]
+            name = table[i + 1:i + 1 + name_len].decode()
+            i += 1 + name_len
+            codec, dtype_len = table[i], table[i + 1]
+            dtype = table[i + 2:i + 2 + dtype_len].decode()
+            i += 2 + dtype_len
+            width, size = np.frombuffer(table[i:i + 8], '<u4')
+            i += 8
+            columns[name] = (codec, dtype, int(width), offset, int(size))
+            offset += int(size)
+        return columns, offset
+
+    def read(self, columns=None, t0=None, t1=None):
+        """Dict of column arrays for blocks with t0 <= time <= t1"""
+        import zlib
+        out = {}
+        with open(self.path, 'rb') as f:
+            for pos, c0, c1, n in self.chunks:
+                if (t0 is not None and c1 < t0) or (t1 is not None and c0 > t1):
+                    continue
+                f.seek(pos + 28)
+                table, _ = self._columns(f)
+                body = f.tell()
+                wanted = columns or list(table)
+                for name in set(wanted) | {'time'}:
+                    codec, dtype, width, offset, size = table[name]
+                    f.seek(body + offset)
+                    raw = zlib.decompress(f.read(size))
+                    itemsize = np.dtype(dtype).itemsize
+                    raw = np.frombuffer(raw, np.uint8).reshape(itemsize, -1).T.tobytes()
+                    data = np.frombuffer(raw, dtype=dtype)
+                    if width > 1:
+                        data = data.reshape(n, width)
+                    if codec == 2:
+                        data = np.cumsum(data, axis=0, dtype=np.int64).astype(np.float32) * REC_SPECTRUM_STEP_DB
+                    out.setdefault(name, []).append(data)
+        if not out:
+            return {}
+        out = {k: np.concatenate(v) for k, v in out.items()}
+        keep = np.ones(len(out['time']), dtype=bool)
+        if t0 is not None:
+            keep &= out['time'] >= t0
+        if t1 is not None:
+            keep &= out['time'] <= t1
+        return {k: v[keep] for k, v in out.items()}
+
+    def peaks(self, t0=None, t1=None):
+        """Rebuild process_audio() peak tuples for analyze_sweep()/detect_tones()"""
+        d = self.read(None, t0, t1)
+        if not d:
+            return []
+        peaks = []
+        for i in range(len(d['time'])):
+            freq = float(d['peak_freq'][i])
+            harmonics = [{'n': n + 1, 'expected_freq': freq * (n + 1),
+                          'actual_freq': float(d['harm_freq'][i, n]), 'db': float(d['harm_db'][i, n])}
+                         for n in range(REC_HARMONICS) if np.isfinite(d['harm_db'][i, n])]
+            info = {'sones': float(d['sones'][i]), 'band_db': d['band_db'][i],
+                    'clipped': int(d['clipped'][i]), 'dc': float(d['dc'][i]),
+                    'rms_db': float(d['rms_db'][i]), 'sample': int(d['sample'][i])}
+            peaks.append((float(d['time'][i]), freq, float(d['peak_db'][i]), harmonics, info))
+        return peaks
+
+
+def recording_metadata(analyzer, source, sweep=None, firmware=None):
+    """Metadata stored in a .bzr header (source: device name or input file, sweep: --sweep-table).
+
+    A live capture records the firmware build (firmware: --firmware, else
+    firmware_build()) and the current time. A re-encoded input file keeps
+    its own date and has no known build unless --firmware names one.
+    """
+    from_file = source is not None and Path(source).is_file()
+    meta = {
+        'created': recording_origin(source)[0] if from_file else datetime.now().isoformat(timespec='seconds'),
+        'source': source,
+        'sample_rate': analyzer.sample_rate,
+        'block_size': analyzer.block_size,
+        'band_hz': [float(analyzer.buzzer_freqs[0]), float(analyzer.buzzer_freqs[-1]),
+                    len(analyzer.buzzer_freqs)],
+        'firmware': {'FREQ_MIN': FREQ_MIN, 'FREQ_MAX': FREQ_MAX, 'FREQ_STEP': FREQ_STEP,
+                     'sweep': [int(f) for f in sweep or sweep_frequencies()],
+                     'build': firmware or (None if from_file else firmware_build())},
+        'analyzer': {'track': analyzer.tracker is not None, 'denoise': analyzer.denoiser is not None,
+                     'spl_offset': analyzer.loudness.spl_offset},
+    }
+    return meta
+
+
+def recording_origin(path):
+    """(date, firmware build) of a recording file, for the unit database.
+
+    A .bzr carries both in its metadata; any other file only has its
+    modification time, and the build is None.
+    """
+    path = Path(path)
+    mtime = datetime.fromtimestamp(path.stat().st_mtime).isoformat(timespec='seconds')
+    if path.suffix == '.bzr':
+        meta = RecordingReader(path).metadata
+        return meta.get('created') or mtime, meta.get('firmware', {}).get('build')
+    return mtime, None
+
+
+def capture_raw(duration, channels, device=None):
+    """Capture raw multi-channel audio until duration elapses or Ctrl+C"""
+    blocks = []
+    running = True
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    old_handler = signal.signal(signal.SIGINT, signal_handler)
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        blocks.append(indata.copy())
+
+    try:
+        with sd.InputStream(samplerate=SAMPLE_RATE, channels=channels,
+                            blocksize=BLOCK_SIZE, callback=audio_callback,
+                            device=device):
+            start = time.time()
+            while running and (time.time() - start) < duration:
+                print(f"\r  {time.time() - start:5.1f}s captured", end="", flush=True)
+                time.sleep(0.1)
+    finally:
+        signal.signal(signal.SIGINT, old_handler)
+    print()
+
+    if not blocks:
+        return np.zeros((0, channels), dtype=np.float32)
+    return np.concatenate(blocks)
+
+
+def logic_edges(logic, sample_rate, invert=False):
+    """Falling (beep start) and rising (beep end) edges of the BUZ- signal.
+
+    Line inputs are AC-coupled, so the logic level itself decays; the
+    sample-to-sample step at each transition survives, so edges are found
+    on the derivative. Returns (falling, rising) sample indices.
+    """
+    d = np.diff(logic.astype(np.float64))
+    if invert:
+        d = -d
+    mad = np.median(np.abs(d - np.median(d))) + 1e-12
+    threshold = max(0.3 * np.max(np.abs(d)), 10 * mad)
+    gap = int(LATENCY_MIN_GAP_MS * sample_rate / 1000)
+
+    def cluster(candidates, values):
+        edges = []
+        for i in candidates:
+            if edges and i - edges[-1] < gap:
+                if abs(values[i]) > abs(values[edges[-1]]):
+                    edges[-1] = i
+                continue
+            edges.append(i)
+        return [e + 1 for e in edges]  # first sample at the new level
+
+    return cluster(np.flatnonzero(d < -threshold), d), cluster(np.flatnonzero(d > threshold), d)
+
+
+def measure_latency(audio, sample_rate, logic_channel=0, mic_distance_m=0.1, invert=False):
+    """Per-beep latency from BUZ- falling edge to sound, split into parts.
+
+    firmware = acoustic onset (10% envelope) - edge - propagation delay;
+               the 10% point sits ~0.1 time constants into ring-up, so
+               this reads a few hundred µs high on a slow piezo
+    ring_up  = 10-90% envelope rise (piezo building up on its mode)
+    total    = 90% point - edge (when the beep is effectively at full level)
+    """
+    logic = audio[:, logic_channel]
+    mic = audio[:, 1 - logic_channel] if audio.shape[1] > 1 else None
+    if mic is None:
+        raise ValueError("Latency mode needs a stereo recording (logic + mic)")
+
+    falling, _ = logic_edges(logic, sample_rate, invert)
+    window = int(LATENCY_WINDOW_MS * sample_rate / 1000)
+    pre = int(0.02 * sample_rate)
+    propagation_ms = mic_distance_m / SPEED_OF_SOUND * 1000
+
+    beeps = []
+    for edge in falling:
+        lo, hi = edge - pre, edge + window
+        if lo < 0 or hi > len(mic):
+            continue
+        segment = mic[lo:hi].astype(np.float64)
+        spec = np.abs(np.fft.rfft(segment[pre:] * np.hanning(window)))
+        freqs = np.fft.rfftfreq(window, 1 / sample_rate)
+        band = (freqs >= FREQ_MIN - 200) & (freqs <= FREQ_MAX + 200)
+        tone_freq = freqs[band][np.argmax(spec[band])]
+
+        env = np.abs(analytic_band(segment, sample_rate, tone_freq))
+        noise = np.median(env[:pre // 2])
+        steady = np.percentile(env[pre:], 90)
+        if steady < 4 * noise:
+            continue
+        i10, i90 = rise_points(env, noise, steady, pre // 2)
+        if i10 is None or i90 is None:
+            continue
+        onset_ms = (i10 - pre) / sample_rate * 1000
+        full_ms = (i90 - pre) / sample_rate * 1000
+        beeps.append({
+            'time_s': edge / sample_rate,
+            'freq': tone_freq,
+            'firmware_ms': onset_ms - propagation_ms,
+            'ring_up_ms': full_ms - onset_ms,
+            'total_ms': full_ms,
+        })
+    return beeps, len(falling)
+
+
+def print_histogram(values, label, bins=12, width=40):
+    """ASCII histogram with summary statistics"""
+    values = np.asarray(values)
+    p5, p50, p95 = np.percentile(values, [5, 50, 95])
+    print(f"\n  {label}: mean {values.mean():.2f} ms, median {p50:.2f}, "
+          f"p5-p95 {p5:.2f}-{p95:.2f}, min {values.min():.2f}, max {values.max():.2f}")
+    counts, edges = np.histogram(values, bins=bins)
+    top = counts.max() or 1
+    for c, lo, hi in zip(counts, edges[:-1], edges[1:]):
+        print(f"  {lo:7.2f}-{hi:7.2f} ms |{'█' * int(round(c / top * width)):<{width}}| {c}")
+
+
+def print_latency(beeps, edge_count):
+    """Latency report with histograms"""
+    print("\n" + "=" * 65)
+    print("ELECTRICAL-TO-ACOUSTIC LATENCY")
+    print("=" * 65)
+    print(f"  BUZ- falling edges: {edge_count}, beeps measured: {len(beeps)}")
+    if not beeps:
+        print("\n❌ No beeps with a clean acoustic onset. Check channel order (--logic-channel)"
+              " and levels.")
+        return
+    print_histogram([b['total_ms'] for b in beeps], "Total (edge → full level)")
+    print_histogram([b['firmware_ms'] for b in beeps], "Firmware (edge → first sound)")
+    print_histogram([b['ring_up_ms'] for b in beeps], "Piezo ring-up (10-90%)")
+    print("=" * 65)
+
+
+def find_mode(freq, spacing_m, duration=None, device=None):
+    """Live bearing display from a stereo mic pair"""
+    print("\n🧭 FIND MODE - stereo GCC-PHAT bearing")
+    print(f"   Buzzer: {freq:.0f} Hz | Mic spacing: {spacing_m * 100:.1f} cm | Ctrl+C to stop")
+    print("-" * 70)
+
+    finder = DirectionFinder(freq, spacing_m=spacing_m)
+    running = True
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, signal_handler)
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        finder.process(indata)
+
+    start_time = time.time()
+    with sd.InputStream(samplerate=SAMPLE_RATE, channels=2,
+                        blocksize=BLOCK_SIZE, callback=audio_callback,
+                        device=device):
+        while running:
+            if duration and (time.time() - start_time) > duration:
+                break
+            if finder.bearing is None:
+                status = "listening..."
+            else:
+                status = f"{finder.bearing:+5.0f}°  conf {finder.confidence:4.2f}"
+            print(f"\r{bearing_gauge(finder.bearing)}  {status}\033[K", end="", flush=True)
+            time.sleep(0.1)
+    print("\n")
+
+
+def find_in_wav(audio, sample_rate, freq, spacing_m):
+    """Run the direction finder over a stereo recording block by block"""
+    finder = DirectionFinder(freq, sample_rate, BLOCK_SIZE, spacing_m)
+    bearings = []
+    print(f"\n{'Time (s)':>9} {'Bearing':>8} {'Delay µs':>9} {'Conf':>5}")
+    for start in range(0, len(audio) - BLOCK_SIZE + 1, BLOCK_SIZE):
+        bearing, conf = finder.process(audio[start:start + BLOCK_SIZE])
+        if conf >= FIND_MIN_CONFIDENCE:
+            bearings.append(bearing)
+            print(f"{start / sample_rate:>9.2f} {bearing:>+7.1f}° {finder.delay_us:>9.1f} {conf:>5.2f}")
+    if bearings:
+        print(f"\n  Bearing: {np.median(bearings):+.1f}° (median of {len(bearings)} blocks)")
+        print(f"  {bearing_gauge(np.median(bearings))}")
+    else:
+        print(f"\n❌ No confident blocks at {freq:.0f} Hz")
+
+
+class BeaconSearch:
+    """Matched-filter detector for a known tone and beep cadence.
+
+    Stage 1: STFT (vectorized over all frames of a chunk) gives, per
+    frame, the strongest bin within ±SEARCH_FREQ_TOL_HZ of the buzzer
+    frequency relative to the median of the neighbouring bins - a
+    tone-to-noise ratio that doesn't care about absolute level.
+    Stage 2: that ratio (dB) is correlated with the beep cadence
+    template over SEARCH_CYCLES cycles using running sums, so each
+    detection integrates seconds of signal and finds beeps far below
+    the block-FFT threshold. The score is normalized by its noise
+    spread (robust std of the per-frame ratio, x1.4 for the 75% frame
+    overlap), so the threshold is in sigmas. Work is O(samples); chunks
+    are streamed with the template length carried over between them.
+    """
+
+    def __init__(self, sample_rate, freq, cadence_ms=SEARCH_CADENCE_MS,
+                 cycles=SEARCH_CYCLES, threshold_sigma=SEARCH_THRESHOLD_SIGMA):
+        self.sample_rate = sample_rate
+        self.frame_rate = sample_rate / SEARCH_HOP
+        self.window = np.hanning(SEARCH_FRAME).astype(np.float32)
+        freqs = np.fft.rfftfreq(SEARCH_FRAME, 1 / sample_rate)
+        self.signal_bins = np.flatnonzero(np.abs(freqs - freq) <= SEARCH_FREQ_TOL_HZ)
+        off = np.abs(freqs - freq)
+        self.noise_bins = np.flatnonzero((off >= 4 * SEARCH_FREQ_TOL_HZ) & (off <= 12 * SEARCH_FREQ_TOL_HZ))
+        self.bin_lo = min(self.signal_bins.min(), self.noise_bins.min())
+        self.bin_hi = max(self.signal_bins.max(), self.noise_bins.max()) + 1
+
+        on_ms, off_ms = cadence_ms
+        self.on = max(1, int(round(on_ms / 1000 * self.frame_rate)))
+        self.period = self.on + max(1, int(round(off_ms / 1000 * self.frame_rate)))
+        self.cycles = cycles
+        self.template_len = self.period * cycles
+        self.threshold_sigma = threshold_sigma
+        n_on = self.on * cycles
+        self.score_spread = 1.4 * np.sqrt(1 / n_on + 1 / (self.template_len - n_on))
+
+        self.sample_carry = np.zeros(0, dtype=np.float32)
+        self.ratio_carry = np.zeros(0)
+        self.frames_done = 0       # Frames already handed to stage 2 (absolute index of ratio_carry[0])
+        self.last_detection = -10 ** 9
+        self.detections = []
+
+    def _frame_ratios(self, samples):
+        """Tone-to-noise ratio (dB) for every complete frame in samples"""
+        n_frames = (len(samples) - SEARCH_FRAME) // SEARCH_HOP + 1
+        if n_frames <= 0:
+            return np.zeros(0), samples
+        frames = np.lib.stride_tricks.sliding_window_view(samples, SEARCH_FRAME)[::SEARCH_HOP][:n_frames]
+        spectra = np.abs(np.fft.rfft(frames * self.window, axis=1)[:, self.bin_lo:self.bin_hi]) ** 2
+        tone = spectra[:, self.signal_bins - self.bin_lo].max(axis=1)
+        noise = np.median(spectra[:, self.noise_bins - self.bin_lo], axis=1) + 1e-20
+        return 10 * np.log10(tone / noise + 1e-12), samples[n_frames * SEARCH_HOP:]
+
+    def feed(self, samples):
+        """Process the next chunk of mono samples; returns new detections"""
+        ratios, self.sample_carry = self._frame_ratios(np.concatenate([self.sample_carry, samples]))
+        r = np.concatenate([self.ratio_carry, ratios])
+        n_pos = len(r) - self.template_len + 1
+        new = []
+        if n_pos > 0:
+            # Cadence matched filter via running sums: mean(on slots) - mean(off slots)
+            csum = np.concatenate([[0.0], np.cumsum(r)])
+            pos = np.arange(n_pos)
+            on_sum = np.zeros(n_pos)
+            for k in range(self.cycles):
+                start = pos + k * self.period
+                on_sum += csum[start + self.on] - csum[start]
+            total = csum[pos + self.template_len] - csum[pos]
+            n_on = self.on * self.cycles
+            n_off = self.template_len - n_on
+            score = on_sum / n_on - (total - on_sum) / n_off
+            sigma_r = 1.4826 * np.median(np.abs(r - np.median(r))) + 1e-9
+            z = score / (sigma_r * self.score_spread)
+
+            # Local maxima above threshold, at most one per beep period
+            above = np.flatnonzero(z > self.threshold_sigma)
+            for i in above:
+                lo, hi = max(0, i - self.period // 2), min(n_pos, i + self.period // 2 + 1)
+                if z[i] < z[lo:hi].max():
+                    continue
+                frame = self.frames_done + i
+                if frame - self.last_detection < self.period:
+                    continue
+                det = {'time_s': frame * SEARCH_HOP / self.sample_rate,
+                       'score_db': float(score[i]), 'sigma': float(z[i])}
+                self.detections.append(det)
+                self.last_detection = frame
+                new.append(det)
+
+            keep = self.template_len - 1
+            self.frames_done += len(r) - keep
+            self.ratio_carry = r[-keep:] if keep else np.zeros(0)
+        else:
+            self.ratio_carry = r
+        return new
+
+
+def search_recording(path, freq, cadence_ms=SEARCH_CADENCE_MS, threshold_sigma=SEARCH_THRESHOLD_SIGMA):
+    """Scan a long recording for the buzzer, printing timestamped detections"""
+    print(f"\n🔎 Searching {path} for {freq:.0f} Hz beeps, cadence "
+          f"{cadence_ms[0]:.0f}/{cadence_ms[1]:.0f} ms, threshold {threshold_sigma:.1f} σ")
+    print("-" * 50)
+    wav = WavReader(path)  # Header first: chunks are SEARCH_CHUNK_S at the file's own rate
+    search = BeaconSearch(wav.rate, freq, cadence_ms, threshold_sigma=threshold_sigma)
+    total_frames = 0
+    t0 = time.perf_counter()
+    for chunk in wav.blocks(int(SEARCH_CHUNK_S * wav.rate)):
+        total_frames += len(chunk)
+        mono = chunk.mean(axis=1) if chunk.shape[1] > 1 else chunk[:, 0]
+        for det in search.feed(mono):
+            t = det['time_s']
+            print(f"  {int(t // 3600):02d}:{int(t % 3600 // 60):02d}:{t % 60:06.3f}  "
+                  f"{det['sigma']:5.1f} σ  (on-off {det['score_db']:4.1f} dB)")
+    elapsed = time.perf_counter() - t0
+    if not total_frames:
+        print("❌ Empty recording")
+        return []
+    duration = total_frames / search.sample_rate
+    print("-" * 50)
+    print(f"  {len(search.detections)} detections in {duration / 60:.1f} min of audio")
+    print(f"  Processed in {elapsed:.1f} s ({duration / max(elapsed, 1e-9):.0f}x real time)")
+    return search.detections
+
+
+class BeaconDecoder:
+    """Separates and labels identity-coded buzzers in one mic stream.
+
+    The firmware hops each beep through ID_CHANNELS channels FREQ_STEP
+    apart, advancing by the unit ID every slot. Every spectral peak in
+    the buzzer band is tracked as a segment (constant frequency run);
+    when a segment ends and another starts right then, the hop size in
+    channels (mod ID_CHANNELS) is the unit ID. Several buzzers just make
+    several interleaved chains, so they are decoded at the same time.
+    Only frequency differences matter, so calibration offsets and mode
+    locking don't affect the decode.
+    """
+
+    def __init__(self, sample_rate=SAMPLE_RATE):
+        self.sample_rate = sample_rate
+        self.window = np.hanning(ID_FRAME).astype(np.float32)
+        self.freqs = np.fft.rfftfreq(ID_FRAME, 1 / sample_rate)
+        self.band = np.flatnonzero((self.freqs >= FREQ_MIN - 2 * FREQ_STEP) &
+                                   (self.freqs <= FREQ_MIN + (ID_CHANNELS + 2) * FREQ_STEP))
+        self.resolution = self.freqs[1]
+        self.carry = np.zeros(0, dtype=np.float32)
+        self.frame_index = 0
+        self.active = []      # Open segments: dict(freq, start, last, db, link)
+        self.recent = []      # Recently closed segments, for linking
+        self.units = {}       # id -> dict(hops, last_seen, freq, db)
+
+    def _frame_peaks(self, spectrum_db):
+        """Local maxima in the band above the median, refined to sub-bin"""
+        band = spectrum_db[self.band]
+        floor = np.median(band)
+        peaks = []
+        for j in range(1, len(band) - 1):
+            if band[j] > floor + ID_PEAK_DB and band[j] >= band[j - 1] and band[j] > band[j + 1]:
+                a, b, c = band[j - 1], band[j], band[j + 1]
+                denom = a - 2 * b + c
+                offset = 0.5 * (a - c) / denom if denom else 0.0
+                peaks.append((self.freqs[self.band[j]] + offset * self.resolution, b))
+        return peaks
+
+    def _link(self, seg, events):
+        """Try to link a finished segment to one that ended as it started"""
+        link_frames = ID_LINK_MS / 1000 * self.sample_rate / ID_HOP
+        best = None
+        for prev in self.recent:
+            gap = seg['start'] - prev['last']
+            if prev.get('next') or abs(gap) > link_frames:
+                continue
+            delta = seg['freq'] - prev['freq']
+            steps = int(round(delta / FREQ_STEP))
+            unit_id = steps % ID_CHANNELS
+            if unit_id == 0 or abs(delta - steps * FREQ_STEP) > ID_FREQ_TOL_HZ:
+                continue
+            # Prefer continuing an existing chain, then close timing and level
+            cost = abs(gap) + abs(seg['db'] - prev['db']) / 3
+            if prev.get('unit') == unit_id:
+                cost -= link_frames
+            elif prev.get('unit') is not None:
+                continue
+            if best is None or cost < best[0]:
+                best = (cost, prev, unit_id)
+        if best is None:
+            return
+        _, prev, unit_id = best
+        prev['next'] = True
+        # Chance links between different buzzers rarely repeat, so a unit
+        # only counts once its chain has ID_CONFIRM_HOPS consistent hops
+        seg['unit'] = unit_id
+        seg['chain'] = prev.get('chain', 0) + 1
+        if seg['chain'] < ID_CONFIRM_HOPS:
+            return
+        unit = self.units.setdefault(unit_id, {'hops': 0, 'last_seen': 0.0, 'freq': 0.0, 'db': -100.0})
+        unit['hops'] += 1
+        unit['last_seen'] = seg['start'] * ID_HOP / self.sample_rate
+        unit['freq'] = seg['freq']
+        unit['db'] = max(seg['db'], prev['db'])
+        if unit['hops'] == 1:
+            events.append((unit['last_seen'], unit_id))
+
+    def feed(self, samples):
+        """Process mono samples; returns list of (time_s, unit_id) for newly confirmed units"""
+        buf = np.concatenate([self.carry, samples.astype(np.float32)])
+        n_frames = (len(buf) - ID_FRAME) // ID_HOP + 1
+        events = []
+        if n_frames <= 0:
+            self.carry = buf
+            return events
+        frames = np.lib.stride_tricks.sliding_window_view(buf, ID_FRAME)[::ID_HOP][:n_frames]
+        spectra = 20 * np.log10(np.abs(np.fft.rfft(frames * self.window, axis=1)) / ID_FRAME + DB_REFERENCE)
+        self.carry = buf[n_frames * ID_HOP:]
+
+        for spectrum_db in spectra:
+            k = self.frame_index
+            self.frame_index += 1
+            for freq, db in self._frame_peaks(spectrum_db):
+                seg = next((s for s in self.active if abs(s['freq'] - freq) < ID_FREQ_TOL_HZ), None)
+                if seg:
+                    seg['last'] = k
+                    seg['db'] = max(seg['db'], db)
+                else:
+                    self.active.append({'freq': freq, 'start': k, 'last': k, 'db': db})
+
+            # Segments silent for two frames are closed; the switching
+            # splatter between slots only lives for a frame or two, so
+            # short segments are dropped before linking
+            for seg in [s for s in self.active if k - s['last'] > 2]:
+                self.active.remove(seg)
+                if seg['last'] - seg['start'] + 1 >= ID_MIN_FRAMES:
+                    self._link(seg, events)
+                    self.recent.append(seg)
+            self.recent = [s for s in self.recent if k - s['last'] < 20]
+        return events
+
+    def status(self, now_s, stale_s=5.0):
+        """One-line summary of confirmed units"""
+        parts = []
+        for unit_id in sorted(self.units):
+            u = self.units[unit_id]
+            if u['hops'] < ID_CONFIRM_HOPS:
+                continue
+            age = now_s - u['last_seen']
+            mark = "●" if age < stale_s else "○"
+            parts.append(f"ID{unit_id} {mark} {u['hops']} hops {u['db']:.0f} dB {age:.1f}s ago")
+        return " | ".join(parts) if parts else "no units yet"
+
+
+def decode_ids_wav(path):
+    """Decode identity beacons in a recording"""
+    decoder = None
+    total = 0
+    print(f"\n📡 Decoding identity beacons in {path}")
+    for rate, chunk in iter_wav_chunks(path, 1 << 16):
+        if decoder is None:
+            decoder = BeaconDecoder(rate)
+        total += len(chunk)
+        for t, unit_id in decoder.feed(chunk.mean(axis=1)):
+            print(f"  {t:8.2f}s  unit ID {unit_id} identified")
+    if decoder:
+        print(f"\n  {decoder.status(total / decoder.sample_rate)}")
+
+
+def decode_ids_live(duration=None, device=None):
+    """Live identity-beacon decoder from the microphone"""
+    import queue
+    print("\n📡 IDENTITY BEACON DECODER - Ctrl+C to stop")
+    print("-" * 70)
+    decoder = BeaconDecoder()
+    identified = queue.Queue()  # (t, unit ID) from the audio callback, printed by the main loop
+    running = True
+    start_time = time.time()
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, signal_handler)
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        for hit in decoder.feed(indata[:, 0]):
+            identified.put(hit)
+
+    with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
+                        blocksize=BLOCK_SIZE, callback=audio_callback,
+                        device=device):
+        while running:
+            now = time.time() - start_time
+            if duration and now > duration:
+                break
+            while True:
+                try:
+                    t, unit_id = identified.get_nowait()
+                except queue.Empty:
+                    break
+                print(f"\r  {t:8.2f}s  unit ID {unit_id} identified\033[K")
+            print(f"\r  {decoder.status(now)}\033[K", end="", flush=True)
+            time.sleep(0.2)
+    print("\n")
+
+
+class AllanAccumulator:
+    """Streaming non-overlapping Allan variance at octave averaging times.
+
+    Level k holds the previous 2^k-interval average and its running sum
+    of squared first differences; pairs of level-k averages feed level
+    k+1. Memory is O(levels) however long the recording. Intervals with
+    no tone are skipped rather than bridged, so a beeping unit's
+    averaging times count tone-on time.
+    """
+
+    def __init__(self, levels=DRIFT_ALLAN_LEVELS):
+        self.prev = [None] * levels
+        self.half = [None] * levels
+        self.sum_sq = np.zeros(levels)
+        self.count = np.zeros(levels, dtype=int)
+
+    def add(self, y, level=0):
+        if level >= len(self.prev):
+            return
+        if self.prev[level] is not None:
+            self.sum_sq[level] += (y - self.prev[level]) ** 2
+            self.count[level] += 1
+        self.prev[level] = y
+        if self.half[level] is None:
+            self.half[level] = y
+        else:
+            self.add((self.half[level] + y) / 2, level + 1)
+            self.half[level] = None
+
+    def deviations(self, base_tau):
+        """[(tau_s, adev, n_differences)] for levels with data"""
+        return [(base_tau * 2 ** k, np.sqrt(self.sum_sq[k] / (2 * self.count[k])), self.count[k])
+                for k in range(len(self.count)) if self.count[k]]
+
+
+def default_modes():
+    """PIEZO_MODES as mode dicts with the assumed DRIFT_DEFAULT_Q"""
+    return [{'center': c, 'q': DRIFT_DEFAULT_Q} for c in PIEZO_MODES]
+
+
+def load_modes_csv(path):
+    """Load modes saved by print_modes()"""
+    import csv
+    with open(path, newline='') as f:
+        return [{'center': float(row['center_hz']), 'q': float(row['q'])} for row in csv.DictReader(f)]
+
+
+class DriftMonitor:
+    """Sub-Hz tone frequency tracking for oscillator stability studies.
+
+    The mic signal is mixed down at the current frequency estimate and
+    summed into 10 ms phasors; the phase advance between consecutive
+    phasors gives the frequency offset, averaged over each interval with
+    only tone-carrying sub-blocks counted. That is far finer than any FFT
+    bin and works on beeping units too. Statistics are streaming (drift
+    regression, Allan accumulators, per-mode dwell, per-minute trend) so
+    memory stays bounded over hours.
+    """
+
+    def __init__(self, sample_rate=SAMPLE_RATE, modes=None, interval_s=DRIFT_INTERVAL_S):
+        self.sample_rate = sample_rate
+        self.sub_len = int(sample_rate * DRIFT_SUBBLOCK_MS / 1000)
+        self.sub_s = self.sub_len / sample_rate
+        self.subs_per_interval = max(2, int(round(interval_s / self.sub_s)))
+        self.interval_s = self.subs_per_interval * self.sub_s
+        self.modes = [dict(m, dwell_s=0.0, streak_s=0.0, longest_s=0.0) for m in (modes or default_modes())]
+
+        self.carry = np.zeros(0, dtype=np.float32)
+        self.sample_index = 0
+        self.f0 = None              # Mixing frequency (last estimate)
+        self.phasors = []           # Current interval: (phasor, tone present)
+        self.acquire = []           # Raw audio for coarse acquisition
+
+        self.intervals = 0
+        self.estimates = 0
+        self.freq = None
+        self.ref_freq = None
+        self.f_min = np.inf
+        self.f_max = -np.inf
+        self.fit_sums = np.zeros(6)  # n, t, f, tt, tf, ff for the drift regression
+        self.allan = AllanAccumulator()
+        self.minute = [0.0, 0, 0.0]  # Running sum/count of the current minute, start time
+        self.history = deque(maxlen=DRIFT_HISTORY_MIN)  # (start minute, mean Hz); oldest drop out
+
+    def _coarse(self, samples):
+        """FFT peak in the buzzer band, parabolic-interpolated"""
+        n = len(samples)
+        spectrum = np.abs(np.fft.rfft(samples * np.hanning(n)))
+        freqs = np.fft.rfftfreq(n, 1 / self.sample_rate)
+        band = np.flatnonzero((freqs >= FREQ_MIN - 2 * FREQ_STEP) & (freqs <= FREQ_MAX + 2 * FREQ_STEP))
+        j = band[np.argmax(spectrum[band])]
+        if spectrum[j] < 10 * np.median(spectrum[band]):
+            return None
+        a, b, c = np.log(spectrum[j - 1:j + 2] + 1e-12)
+        denom = a - 2 * b + c
+        return freqs[j] + (0.5 * (a - c) / denom if denom else 0.0) * freqs[1]
+
+    def feed(self, samples):
+        """Process mono samples; returns list of (time_s, freq_hz) interval estimates"""
+        buf = np.concatenate([self.carry, samples.astype(np.float32)])
+        n_sub = len(buf) // self.sub_len
+        self.carry = buf[n_sub * self.sub_len:]
+        out = []
+        for block in buf[:n_sub * self.sub_len].reshape(n_sub, self.sub_len):
+            if self.f0 is None:
+                self.acquire.append(block)
+                if len(self.acquire) == self.subs_per_interval:
+                    self.f0 = self._coarse(np.concatenate(self.acquire))
+                    self.acquire = []
+                self.sample_index += self.sub_len
+                continue
+
+            # Phase reference runs on absolute sample time so phasors chain
+            n = self.sample_index + np.arange(self.sub_len)
+            z = np.dot(block, np.exp(-2j * np.pi * self.f0 * (n / self.sample_rate)))
+            energy = float(np.dot(block, block))
+            purity = abs(z) ** 2 / (energy * self.sub_len / 2) if energy > 0 else 0.0
+            self.phasors.append((z, purity >= DRIFT_MIN_PURITY))
+            self.sample_index += self.sub_len
+            if len(self.phasors) == self.subs_per_interval:
+                estimate = self._close_interval()
+                if estimate:
+                    out.append(estimate)
+        return out
+
+    def _close_interval(self):
+        """Frequency estimate from the interval's phasor pairs"""
+        phasors, self.phasors = self.phasors, []
+        self.intervals += 1
+        d = sum(z1 * np.conj(z0) for (z0, ok0), (z1, ok1) in zip(phasors, phasors[1:]) if ok0 and ok1)
+        pairs = sum(1 for (_, ok0), (_, ok1) in zip(phasors, phasors[1:]) if ok0 and ok1)
+        t = self.sample_index / self.sample_rate
+        if pairs < DRIFT_MIN_PAIRS:
+            self._end_streaks()
+            if self.freq is None:
+                self.f0 = None      # Acquired on noise; try again
+            return None
+
+        freq = self.f0 + np.angle(d) / (2 * np.pi * self.sub_s)
+        if self.freq is not None and abs(freq - self.freq) > DRIFT_JUMP_HZ:
+            # A different tone (recalibration, ID hop): start over on it
+            self.f0 = None
+            self._end_streaks()
+            return None
+        self.f0 = freq
+        self._record(t, freq)
+        return t, freq
+
+    def _record(self, t, freq):
+        self.freq = freq
+        self.estimates += 1
+        if self.ref_freq is None:
+            self.ref_freq = freq
+        self.f_min = min(self.f_min, freq)
+        self.f_max = max(self.f_max, freq)
+        df = freq - self.ref_freq
+        self.fit_sums += (1, t, df, t * t, t * df, df * df)
+        self.allan.add((freq - self.ref_freq) / self.ref_freq)
+
+        for m in self.modes:
+            if abs(freq - m['center']) <= m['center'] / (2 * m['q']):
+                m['dwell_s'] += self.interval_s
+                m['streak_s'] += self.interval_s
+                m['longest_s'] = max(m['longest_s'], m['streak_s'])
+            else:
+                m['streak_s'] = 0.0
+
+        if not self.minute[1]:
+            self.minute[2] = t
+        self.minute[0] += freq
+        self.minute[1] += 1
+        if self.minute[1] * self.interval_s >= 60:
+            self.history.append((self.minute[2] / 60, self.minute[0] / self.minute[1]))
+            self.minute = [0.0, 0, 0.0]
+
+    def _end_streaks(self):
+        for m in self.modes:
+            m['streak_s'] = 0.0
+
+    def drift_rate(self):
+        """Least-squares drift (Hz/hour, standard error) or (None, None)"""
+        n, st, sf, stt, stf, sff = self.fit_sums
+        if n < 3:
+            return None, None
+        var_t = stt / n - (st / n) ** 2
+        if var_t <= 0:
+            return None, None
+        cov_tf = stf / n - st / n * sf / n
+        slope = cov_tf / var_t
+        residual_var = max(sff / n - (sf / n) ** 2 - slope * cov_tf, 0.0) * n / (n - 2)
+        stderr = np.sqrt(residual_var / (n * var_t))
+        return slope * 3600, stderr * 3600
+
+    def current_mode(self):
+        """The mode whose band holds the current frequency, or None"""
+        if self.freq is None:
+            return None
+        return next((m for m in self.modes
+                     if abs(self.freq - m['center']) <= m['center'] / (2 * m['q'])), None)
+
+    def status(self):
+        """One-line live summary"""
+        if self.freq is None:
+            return "acquiring tone..."
+        rate, _ = self.drift_rate()
+        mode = self.current_mode()
+        parts = [f"{self.freq:8.2f} Hz", f"Δ {self.freq - self.ref_freq:+6.2f} Hz"]
+        if rate is not None:
+            parts.append(f"drift {rate:+6.2f} Hz/h")
+        adev = self.allan.deviations(self.interval_s)
+        if adev:
+            parts.append(f"σy(1s) {adev[0][1]:.1e}")
+        parts.append(f"mode {mode['center']:.0f}" if mode else "OUT OF MODE")
+        return " | ".join(parts)
+
+
+def print_drift(monitor):
+    """Print the drift/stability report"""
+    if monitor.estimates < 2:
+        print("\n❌ Not enough tone to estimate drift")
+        return
+
+    tracked_s = monitor.estimates * monitor.interval_s
+    total_s = monitor.intervals * monitor.interval_s
+    rate, rate_err = monitor.drift_rate()
+    ppm = 1e6 / monitor.ref_freq
+
+    print("\n🌡️  OSCILLATOR DRIFT REPORT")
+    print("=" * 60)
+    print(f"  Tone tracked:  {tracked_s / 60:.1f} of {total_s / 60:.1f} min")
+    print(f"  Frequency:     {monitor.ref_freq:.2f} Hz at start, {monitor.freq:.2f} Hz at end")
+    print(f"  Range:         {monitor.f_min:.2f} - {monitor.f_max:.2f} Hz "
+          f"({(monitor.f_max - monitor.f_min) * ppm:.0f} ppm)")
+    if rate is not None:
+        print(f"  Drift rate:    {rate:+.3f} ±{1.96 * rate_err:.3f} Hz/hour ({rate * ppm:+.0f} ppm/hour)")
+
+    print("\n  Allan deviation:")
+    print(f"  {'Tau':>10} {'σy':>10} {'σ (Hz)':>9} {'N':>7}")
+    for tau, adev, count in monitor.allan.deviations(monitor.interval_s):
+        tau_str = f"{tau:.0f} s" if tau < 120 else f"{tau / 60:.0f} min"
+        print(f"  {tau_str:>10} {adev:>10.2e} {adev * monitor.ref_freq:>9.3f} {count:>7}")
+
+    print("\n  Time within each mode's half-power band:")
+    print(f"  {'Mode (Hz)':>10} {'Band (Hz)':>14} {'Dwell':>9} {'Share':>6} {'Longest':>9}")
+    for m in monitor.modes:
+        half = m['center'] / (2 * m['q'])
+        if m['dwell_s'] == 0 and abs(monitor.ref_freq - m['center']) > 3 * half:
+            continue
+        print(f"  {m['center']:>10.0f} {m['center'] - half:>6.0f}-{m['center'] + half:<7.0f} "
+              f"{m['dwell_s'] / 60:>7.1f} m {100 * m['dwell_s'] / tracked_s:>5.0f}% {m['longest_s'] / 60:>7.1f} m")
+
+    if monitor.history:
+        step = -(-len(monitor.history) // 12)
+        print("\n  Trend (per-minute mean):")
+        for i in range(0, len(monitor.history), step):
+            minute, freq = monitor.history[i]
+            print(f"  {minute:>5.0f} min  {freq:9.2f} Hz")
+
+    # When will the tone leave its mode at the measured rate?
+    mode = monitor.current_mode()
+    print()
+    if mode is None:
+        print("  ⚠️  Tone is outside every mode band - trim OSCCAL or recalibrate")
+    elif rate:
+        half = mode['center'] / (2 * mode['q'])
+        edge = mode['center'] + half if rate > 0 else mode['center'] - half
+        hours = (edge - monitor.freq) / rate
+        note = "⚠️ " if hours < 1 else "✅"
+        print(f"  {note} At {rate:+.2f} Hz/h the tone leaves the {mode['center']:.0f} Hz mode in "
+              f"{hours:.1f} h" + (" - trim OSCCAL or recalibrate" if hours < 1 else ""))
+    print("=" * 60)
+
+
+def drift_wav(path, modes=None, output_file=None):
+    """Drift study of a recording, streamed in chunks"""
+    monitor = None
+    log = open(output_file, 'w') if output_file else None
+    if log:
+        log.write("time_s,freq_hz\n")
+    print(f"\n🌡️  Tracking tone frequency in {path}")
+    start = time.time()
+    for rate, chunk in iter_wav_chunks(path, 1 << 16):
+        if monitor is None:
+            monitor = DriftMonitor(rate, modes)
+        for t, freq in monitor.feed(chunk.mean(axis=1)):
+            if log:
+                log.write(f"{t:.2f},{freq:.4f}\n")
+    if log:
+        log.close()
+        print(f"📁 Frequency log saved to: {output_file}")
+    if monitor:
+        audio_s = monitor.sample_index / monitor.sample_rate
+        print(f"  {audio_s / 60:.1f} min analyzed in {time.time() - start:.1f} s")
+        print_drift(monitor)
+
+
+def drift_live(modes=None, duration=None, output_file=None, device=None):
+    """Live drift study from the microphone; report on Ctrl+C"""
+    print("\n🌡️  OSCILLATOR DRIFT STUDY - Ctrl+C to stop and report")
+    print("-" * 70)
+    monitor = DriftMonitor(SAMPLE_RATE, modes)
+    log = open(output_file, 'w') if output_file else None
+    if log:
+        log.write("time_s,freq_hz\n")
+    pending = deque()
+    running = True
+    start_time = time.time()
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, signal_handler)
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        pending.extend(monitor.feed(indata[:, 0]))
+
+    with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
+                        blocksize=BLOCK_SIZE, callback=audio_callback,
+                        device=device):
+        while running:
+            if duration and time.time() - start_time > duration:
+                break
+            while pending:
+                t, freq = pending.popleft()
+                if log:
+                    log.write(f"{t:.2f},{freq:.4f}\n")
+            print(f"\r  {monitor.status()}\033[K", end="", flush=True)
+            time.sleep(0.5)
+    if log:
+        log.close()
+        print(f"\n📁 Frequency log saved to: {output_file}")
+    print_drift(monitor)
+
+
+class BeeperDecoder:
+    """Classifies Betaflight beeper events from the buzzer's beep cadence.
+
+    Audio is cut into BEEPER_FRAME frames whose buzzer-band peak level
+    feeds a ToneSegmenter (threshold tracks the noise floor), so beeps
+    and pauses are timed to ~12 ms rather than one analyzer block. Closed
+    tones build an on/off sequence which is matched against
+    BEEPER_PATTERNS. A sequence that already equals one pattern and can't
+    grow into another is reported as its last beep ends; otherwise the
+    decision waits for BEEPER_SEQ_GAP_S of silence. Repeats of the same
+    event are counted instead of reported again.
+    """
+
+    def __init__(self, sample_rate=SAMPLE_RATE):
+        self.sample_rate = sample_rate
+        self.window = np.hanning(BEEPER_FRAME).astype(np.float32)
+        freqs = np.fft.rfftfreq(BEEPER_FRAME, 1 / sample_rate)
+        self.band = (freqs >= FREQ_MIN - 2 * FREQ_STEP) & (freqs <= FREQ_MAX + 2 * FREQ_STEP)
+        self.frame_s = BEEPER_FRAME / sample_rate
+        self.segmenter = ToneSegmenter(threshold_db=np.inf, min_duration=0.02, min_samples=2)
+        self.floor_db = None
+        self.carry = np.zeros(0, dtype=np.float32)
+        self.frames = 0
+        self.sequence = []      # Closed tones of the pattern being assembled: (start, end)
+        self.last_event = None  # (label, time_s, repeats)
+        self.last_names = None  # Candidate patterns and end time of the previous sequence
+        self.last_end = 0.0
+
+    def _matches(self, durations_ms):
+        """(patterns equal to the sequence, patterns it is a proper prefix of)"""
+        def close(measured, ref):
+            return abs(measured - ref) <= max(BEEPER_TOL_MS, BEEPER_TOL_REL * ref)
+
+        equal, longer = [], []
+        for name, units in BEEPER_PATTERNS.items():
+            ref = [10 * u for u in units]
+            if len(ref) < len(durations_ms):
+                continue
+            if all(close(m, r) for m, r in zip(durations_ms, ref)):
+                (equal if len(ref) == len(durations_ms) else longer).append(name)
+        return equal, longer
+
+    def _durations(self):
+        out = []
+        for i, (start, end) in enumerate(self.sequence):
+            if i:
+                out.append(1000 * (start - self.sequence[i - 1][1]))
+            out.append(1000 * (end - start))
+        return out
+
+    def _emit(self, names, t):
+        durations = self._durations()
+        self.sequence = []
+        # Patterns that only differ by how often they repeat
+        if len(names) > 1 and self.last_names == names:
+            period_ms = 1000 * (t - self.last_end)
+            by_period = [n for n in names if n in BEEPER_REPEAT_MS and
+                         abs(period_ms - BEEPER_REPEAT_MS[n]) <= max(BEEPER_TOL_MS, BEEPER_TOL_REL * BEEPER_REPEAT_MS[n])]
+            if len(by_period) == 1:
+                names = by_period
+        elif len(names) > 1 and self.last_event and self.last_event[0] in names:
+            names = [self.last_event[0]]
+        self.last_names, self.last_end = names, t
+        if names:
+            label = " / ".join(names)
+        else:
+            label = "UNKNOWN " + "/".join(f"{d:.0f}" for d in durations) + " ms"
+        if self.last_event and self.last_event[0] == label and t - self.last_event[1] < 5.0:
+            self.last_event = (label, t, self.last_event[2] + 1)
+        else:
+            self.last_event = (label, t, 1)
+        return self.last_event
+
+    def feed(self, samples):
+        """Process mono samples; returns list of (label, time_s, repeats) events"""
+        buf = np.concatenate([self.carry, samples.astype(np.float32)])
+        n = len(buf) // BEEPER_FRAME
+        self.carry = buf[n * BEEPER_FRAME:]
+        if n == 0:
+            return []
+        frames = buf[:n * BEEPER_FRAME].reshape(n, BEEPER_FRAME) * self.window
+        spectra = np.abs(np.fft.rfft(frames, axis=1))[:, self.band] * (2 / BEEPER_FRAME)
+        levels = 20 * np.log10(spectra.max(axis=1) + DB_REFERENCE)
+
+        events = []
+        for level in levels:
+            t = self.frames * self.frame_s
+            self.frames += 1
+            # Floor follows quiet frames quickly and beeps only slowly
+            if self.floor_db is None:
+                self.floor_db = level
+            rate = 0.2 if level < self.floor_db else 0.002
+            self.floor_db += rate * (level - self.floor_db)
+            self.segmenter.threshold_db = self.floor_db + BEEPER_ON_DB
+
+            tone = self.segmenter.push((t, 0.0, level))
+            if tone:
+                self.sequence.append((tone['start'], tone['end']))
+                equal, longer = self._matches(self._durations())
+                if equal and not longer:
+                    events.append(self._emit(equal, tone['end']))
+                elif not equal and not longer:
+                    events.append(self._emit([], tone['end']))
+            elif (self.sequence and not self.segmenter.in_tone
+                  and t - self.sequence[-1][1] >= BEEPER_SEQ_GAP_S):
+                equal, _ = self._matches(self._durations())
+                events.append(self._emit(equal, self.sequence[-1][1]))
+        return events
+
+
+def beeper_event_str(event):
+    label, t, repeats = event
+    return f"🔔 {t:8.2f}s  {label}" + (f" (x{repeats})" if repeats > 1 else "")
+
+
+def decode_beeper_wav(path):
+    """Decode Betaflight beeper events in a recording"""
+    decoder = None
+    print(f"\n🔔 Decoding Betaflight beeper events in {path}")
+    for rate, chunk in iter_wav_chunks(path, 1 << 16):
+        if decoder is None:
+            decoder = BeeperDecoder(rate)
+        for event in decoder.feed(chunk.mean(axis=1)):
+            print(f"  {beeper_event_str(event)}")
+    # Trailing silence so a final pattern is decided
+    if decoder:
+        for event in decoder.feed(np.zeros(int(decoder.sample_rate * BEEPER_SEQ_GAP_S) + BEEPER_FRAME)):
+            print(f"  {beeper_event_str(event)}")
+
+
+class TerminalRenderer:
+    """Diff-based redraw of a fixed block of terminal rows.
+
+    draw() takes the whole frame as rows of (char, style) cells (style
+    is an SGR parameter string, '' for default) and writes only the
+    span of each row that differs from the previous frame, in a single
+    write. A change in frame size (terminal resize, rows added) redraws
+    everything. log() prints a line above the block, which scrolls with
+    the terminal output as plain prints would.
+    """
+
+    def __init__(self, out=None):
+        self.out = out or sys.stdout
+        self.prev = []
+        self.row = 0  # Cursor row inside the block
+
+    def _move(self, row):
+        step = row - self.row
+        self.row = row
+        if step > 0:
+            return f"\033[{step}B"
+        return f"\033[{-step}A" if step else ""
+
+    @staticmethod
+    def _span(cells, start, end):
+        parts = []
+        style = None
+        for char, cell_style in cells[start:end]:
+            if cell_style != style:
+                parts.append(f"\033[0;{cell_style}m" if cell_style else "\033[0m")
+                style = cell_style
+            parts.append(char)
+        if style:
+            parts.append("\033[0m")
+        return "".join(parts)
+
+    def draw(self, rows):
+        out = []
+        if len(rows) != len(self.prev) or any(len(a) != len(b) for a, b in zip(rows, self.prev)):
+            # Full redraw from the top of the block
+            out.append(self._move(0) + "\r\033[J" if self.prev else "")
+            out.append("\n".join(self._span(cells, 0, len(cells)) for cells in rows))
+            self.row = len(rows) - 1
+        else:
+            for r, (cells, old) in enumerate(zip(rows, self.prev)):
+                changed = [i for i, (a, b) in enumerate(zip(cells, old)) if a != b]
+                if not changed:
+                    continue
+                start, end = changed[0], changed[-1] + 1
+                out.append(self._move(r) + "\r" + (f"\033[{start}C" if start else ""))
+                out.append(self._span(cells, start, end))
+        self.prev = rows
+        if any(out):
+            self.out.write("".join(out))
+            self.out.flush()
+
+    def log(self, text):
+        """Print a line above the block; the block is redrawn below it"""
+        if self.prev:
+            self.out.write(self._move(0) + "\r\033[J")
+        self.out.write(text + "\n")
+        self.prev = []
+        self.row = 0
+
+    def close(self):
+        if self.prev:
+            self.out.write(self._move(len(self.prev) - 1) + "\n")
+        self.out.flush()
+
+
+def _cells(text, style=''):
+    return [(char, style) for char in text]
+
+
+def _db_levels(spectrum, width):
+    """Band spectrum resampled to width columns, 0-1 on the fixed LIVE_DB_RANGE"""
+    lo, hi = LIVE_DB_RANGE
+    indices = np.linspace(0, len(spectrum) - 1, width).astype(int)
+    return np.clip((spectrum[indices] - lo) / (hi - lo), 0.0, 1.0)
+
+
+def monitor_frame(snap, waterfall, width, spectrum_rows=0):
+    """Rows of cells for the live monitor from one BlockSnapshot.
+
+    Row 0 is the classic one-line status; spectrum_rows adds a bar graph
+    of the smoothed band spectrum and each spectrum in waterfall (newest
+    first) adds one waterfall row.
+    """
+    freq_str = f"{snap.peak_freq:4.0f} Hz"
+    if snap.learning:
+        freq_str = "learning noise"
+    if snap.tracking:
+        freq_str += f" ({snap.track_confidence:3.0%})"
+    h_count = sum(1 for n, db in snap.harmonics if n > 1 and db > HARMONIC_AUDIBLE_DB)
+    h_str = f" H:{h_count}" if len(snap.harmonics) > 1 and h_count else ""
+
+    # Color coding for terminal (ANSI)
+    if snap.peak_db > -20:
+        color = "92"  # Green - loud
+    elif snap.peak_db > -35:
+        color = "93"  # Yellow - medium
+    else:
+        color = "91"  # Red - quiet
+
+    status = _cells(f"Peak: {freq_str} | {snap.peak_db:5.1f} dB{h_str}", color)
+    status += _cells(f" | [{spectrum_bar(snap.smoothed, 40)}]")
+    warnings = health_warnings(snap.clip_hold, snap.dc_offset)
+    if warnings:
+        status += _cells(" ⚠ " + warnings, "91")
+    rows = [status]
+
+    graph_width = max(10, width - 2)
+    if spectrum_rows:
+        bar_chars = " ▁▂▃▄▅▆▇█"
+        eighths = np.round(_db_levels(snap.smoothed, graph_width) * spectrum_rows * 8).astype(int)
+        for r in range(spectrum_rows):
+            fill = np.clip(eighths - (spectrum_rows - 1 - r) * 8, 0, 8)
+            rows.append(_cells("│" + "".join(bar_chars[f] for f in fill) + "│", "96"))
+    for spectrum in waterfall:
+        levels = (_db_levels(spectrum, graph_width) * (len(WATERFALL_CHARS) - 1)).astype(int)
+        rows.append(_cells("│" + "".join(WATERFALL_CHARS[v] for v in levels) + "│", "36"))
+    if spectrum_rows or waterfall:
+        left, right = f"{FREQ_MIN} Hz", f"{FREQ_MAX} Hz"
+        rows.append(_cells(" " + left + " " * (graph_width - len(left) - len(right)) + right + " ", "2"))
+
+    # Fixed width so shorter rows overwrite longer ones
+    return [cells[:width] + [(' ', '')] * (width - len(cells)) for cells in rows]
+
+
+def live_monitor(analyzer, duration=None, device=None, beeper=False, spectrum_rows=0, waterfall_rows=0):
+    """Live spectrum monitoring with terminal display.
+
+    The audio callback only analyzes and publishes an immutable
+    BlockSnapshot; the main thread renders the newest one with a
+    TerminalRenderer, so drawing never competes with analysis for the
+    analyzer's state. spectrum_rows/waterfall_rows add a multi-row
+    spectrum graph and a scrolling waterfall under the status line.
+
+    beeper: also decode Betaflight beeper events; each is printed on its
+    own line above the display.
+    """
+    import shutil
+
+    print("\n🎤 Live Spectrum Monitor")
+    print(f"   Range: {FREQ_MIN}-{FREQ_MAX} Hz | Press Ctrl+C to stop")
+    print("-" * 70)
+
+    running = True
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    signal.signal(signal.SIGINT, signal_handler)
+
+    start_time = time.time()
+    decoder = BeeperDecoder(SAMPLE_RATE) if beeper else None
+    events = deque()
+    snapshots = deque(maxlen=64)  # Published by the callback, consumed by the renderer
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        analyzer.process_audio(indata)
+        snapshots.append(analyzer.snapshot())
+        if decoder:
+            events.extend(decoder.feed(indata[:, 0]))
+
+    renderer = TerminalRenderer()
+    waterfall = deque(maxlen=waterfall_rows)
+    snap = None
+    with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
+                        blocksize=BLOCK_SIZE, callback=audio_callback,
+                        device=device):
+        while running:
+            if duration and (time.time() - start_time) > duration:
+                break
+
+            while events:
+                renderer.log(beeper_event_str(events.popleft()))
+
+            fresh = False
+            while snapshots:
+                snap = snapshots.popleft()
+                if waterfall_rows:
+                    waterfall.appendleft(snap.spectrum)
+                fresh = True
+            if fresh or not renderer.prev and snap:
+                width = min(shutil.get_terminal_size().columns - 1, 160)
+                renderer.draw(monitor_frame(snap, waterfall, width, spectrum_rows))
+
+            time.sleep(LIVE_REFRESH_S)
+
+    renderer.close()
+    print()
+
+
+def record_sweep(analyzer, sweep_duration=50, device=None):
+    """Record a complete calibration sweep"""
+    print("\n🔴 RECORDING MODE")
+    print("=" * 65)
+    print(f"   Expected sweep duration: ~{sweep_duration} seconds")
+    print("   Range: 2400-4500 Hz, step 100 Hz")
+    print("\n   1. Connect buzzer (don't power on yet)")
+    print("   2. Short PB1 to GND for calibration mode")
+    print("   3. Power on buzzer")
+    print("   4. Press Enter when ready to start recording...")
+
+    input()
+
+    print("\n🎤 Recording... Press Ctrl+C when sweep completes")
+    print("-" * 65)
+
+    analyzer.start_recording()
+    running = True
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    old_handler = signal.signal(signal.SIGINT, signal_handler)
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        analyzer.process_audio(indata)
+
+    try:
+        with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS,
+                            blocksize=BLOCK_SIZE, callback=audio_callback,
+                            device=device):
+            start = time.time()
+            while running:
+                elapsed = time.time() - start
+                bar = analyzer.get_spectrum_bar(40)
+                saved = f" | 💾 {analyzer.tone_log.count} tones" if analyzer.tone_log else ""
+                print(f"\r  {elapsed:5.1f}s | Peak: {analyzer.peak_freq:4.0f} Hz "
+                      f"| {analyzer.peak_db:5.1f} dB | [{bar}]{saved}{analyzer.health_str()}\033[K",
+                      end="", flush=True)
+                time.sleep(0.1)
+    finally:
+        signal.signal(signal.SIGINT, old_handler)
+
+    print("\n\n⏹ Recording stopped")
+
+    peaks = analyzer.stop_recording()
+    print(f"   Recorded {len(peaks)} samples over {peaks[-1][0]:.1f} seconds")
+
+    return peaks
+
+
+class ArmedRecorder:
+    """Hands-free sweep capture: armed, triggered by the intro, stops after one sweep.
+
+    While armed, a lightweight analyzer watches every block and the raw
+    blocks go into a ring of ARM_RING_S. Two intro beeps at INTRO_FREQ
+    with the firmware's beep/pause lengths trigger a fresh analyzer,
+    which first replays the ring from ARM_PRETRIGGER_S before the first
+    beep and then follows the live blocks. Recording ends once all
+    sweep tones have been heard (plus ARM_TAIL_S), after
+    ARM_SILENCE_S of silence or at 1.5x the expected sweep length;
+    feed() then returns the finished analyzer and the recorder is armed
+    again for the next unit.
+    """
+
+    def __init__(self, make_analyzer, sweep=None):
+        self.make_analyzer = make_analyzer
+        self.detector = make_analyzer()
+        self.sample_rate = self.detector.sample_rate
+        self.block_s = self.detector.block_size / self.sample_rate
+        self.ring = deque(maxlen=int(np.ceil(ARM_RING_S / self.block_s)))
+        self.sweep_len = len(sweep or sweep_frequencies())
+        self.max_s = 1.5 * (INTRO_TOTAL_MS / 1000 + self.sweep_len * (CALIB_TONE_S + CALIB_PAUSE_S))
+        self.t = 0.0
+        self.runs = 0
+        self._arm()
+
+    def _arm(self):
+        self.recording = None
+        self.intro = ToneSegmenter(min_duration=ARM_BEEP_S[0], min_samples=2)
+        self.last_intro = None
+
+    @property
+    def armed(self):
+        return self.recording is None
+
+    def feed(self, block):
+        """Process one block; returns the recording analyzer when a sweep completes"""
+        self.t += self.block_s
+        if self.armed:
+            self.ring.append((block, self.t))
+            freq, db = self.detector.process_audio(block)
+            if abs(freq - INTRO_FREQ) > ARM_FREQ_TOL_HZ:
+                db = -np.inf
+            tone = self.intro.push((self.t, freq, db))
+            if tone and ARM_BEEP_S[0] <= tone['duration'] <= ARM_BEEP_S[1]:
+                first = self.last_intro
+                if first and ARM_GAP_S[0] <= tone['start'] - first['end'] <= ARM_GAP_S[1]:
+                    self._trigger(first['start'] - self.block_s - ARM_PRETRIGGER_S)
+                else:
+                    self.last_intro = tone
+            return None
+
+        rec = self.recording
+        rec.process_audio(block, timestamp=self.t - self.t0)
+        tone = self.counter.push(rec.recorded_peaks[-1])
+        if tone:
+            self.sweep_tones += 1
+            self.last_tone_end = tone['end']
+        elapsed = self.t - self.t0
+        quiet = elapsed - self.last_tone_end
+        done = (self.sweep_tones >= self.sweep_len and quiet >= ARM_TAIL_S and not self.counter.in_tone)
+        if done or (quiet >= ARM_SILENCE_S and not self.counter.in_tone) or elapsed > self.max_s:
+            rec.stop_recording()
+            self.runs += 1
+            self.ring.clear()
+            self._arm()
+            return rec
+        return None
+
+    def _trigger(self, t_start):
+        """Start a recording at t_start, replaying the ring from there"""
+        self.t0 = t_start
+        self.recording = self.make_analyzer()
+        self.recording.start_recording()
+        self.counter = ToneSegmenter()
+        self.sweep_tones = 0
+        self.last_tone_end = 0.0
+        for block, t in self.ring:
+            if t - self.block_s >= t_start - self.block_s / 2:
+                self.recording.process_audio(block, timestamp=t - t_start)
+                self.counter.push(self.recording.recorded_peaks[-1])
+
+    def status(self):
+        if self.armed:
+            return f"🎯 ARMED - waiting for intro beeps ({self.runs} units so far)"
+        return (f"🔴 REC unit #{self.runs + 1}: {self.t - self.t0:5.1f} s, "
+                f"{self.sweep_tones}/{self.sweep_len} tones")
+
+
+def armed_unit_id(args, n):
+    """Unit ID of the n-th sweep captured in armed mode: --unit, input file name or 'unit', numbered"""
+    base = args.unit or (Path(args.input).stem if args.input else "unit")
+    return f"{base}-{n:03d}"
+
+
+def run_armed(args, device=None):
+    """Armed mode: record and report one sweep per powered-on unit, hands-free"""
+    import copy
+
+    make = lambda: SpectrumAnalyzer(sample_rate=rate, track=args.track, spl_offset=args.spl_offset,
+                                    denoise=args.denoise, keep_audio=args.onsets)
+    # Every captured unit gets its own file: a replay reports several units within one second
+    output = Path(args.output or default_output_file())
+
+    def report(rec):
+        run_args = copy.copy(args)
+        n = armed.runs
+        run_args.output = str(output.with_name(f"{output.stem}_{n:03d}.csv"))
+        run_args.unit = armed_unit_id(args, n)
+        print(f"\n\n✅ Unit #{n}: sweep captured ({rec.recorded_peaks[-1][0]:.1f} s)")
+        report_sweep(rec, rec.recorded_peaks, run_args)
+
+    if args.input:
+        rate = WavReader(args.input).rate
+        armed = ArmedRecorder(make, args.sweep)
+        print(f"\n🎯 Replaying {args.input} through the armed recorder")
+        for block in WavReader(args.input).blocks(BLOCK_SIZE, pad=True):
+            rec = armed.feed(block.mean(axis=1))
+            if rec:
+                report(rec)
+        print(f"\n  {armed.runs} sweep{'s' if armed.runs != 1 else ''} captured")
+        return
+
+    import queue
+    rate = SAMPLE_RATE
+    armed = ArmedRecorder(make, args.sweep)
+    blocks = queue.Queue()
+    running = True
+
+    def signal_handler(sig, frame):
+        nonlocal running
+        running = False
+
+    def audio_callback(indata, frames, time_info, status):
+        count_overflow(status)
+        blocks.put(indata[:, 0].copy())
+
+    old_handler = signal.signal(signal.SIGINT, signal_handler)
+    print("\n🎯 ARMED MODE - power on units in calibration mode one after another. Ctrl+C to quit")
+    print("-" * 65)
+    try:
+        with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS, blocksize=BLOCK_SIZE,
+                            device=device, callback=audio_callback):
+            start = time.time()
+            while running and not (args.duration and time.time() - start > args.duration):
+                try:
+                    block = blocks.get(timeout=0.1)
+                except queue.Empty:
+                    continue
+                rec = armed.feed(block)
+                if rec:
+                    report(rec)
+                    print("\n🎯 Re-armed for the next unit")
+                print(f"\r  {armed.status()}{armed.detector.health_str()}\033[K", end="", flush=True)
+    finally:
+        signal.signal(signal.SIGINT, old_handler)
+    print(f"\n\n  {armed.runs} unit{'s' if armed.runs != 1 else ''} recorded")
+
+
+class JsonStream:
+    """JSON-lines event sink for bench automation (stdout or a Unix socket).
+
+    emit() never does I/O itself: each consumer has a queue of at most
+    STREAM_QUEUE_LINES lines drained by its own writer thread. Live
+    (lossless=False), a consumer that falls behind loses 'block' events
+    (a 'dropped' event with the count precedes the next line it gets);
+    tone, sweep and end events are never dropped. On stdout they wait
+    for the reader; a socket client that can't take one within
+    STREAM_STALL_S is disconnected so it can't hold up the analysis or
+    other clients. Replaying a file (lossless=True) nothing is dropped:
+    the analysis simply runs at the pace of the slowest consumer.
+    target '-' is stdout, anything else a Unix socket path; clients may
+    connect and disconnect at any time and start with the 'hello' event.
+    """
+
+    def __init__(self, target, hello, lossless=False):
+        import json
+        import os
+        import threading
+        self.json = json
+        self.os = os
+        self.lost = 0
+        self.lossless = lossless
+        self.hello = self._line(dict(hello, type='hello'))
+        self.clients = []
+        self.lock = threading.Lock()
+        self.server = None
+        self.path = None
+        if target == '-':
+            self._add(sys.__stdout__, socket=False)
+        else:
+            import socket
+            self.path = target
+            if os.path.exists(target):
+                os.unlink(target)  # Stale socket from a previous run
+            self.server = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            self.server.bind(target)
+            self.server.listen()
+            threading.Thread(target=self._accept, daemon=True).start()
+
+    def _line(self, event):
+        return self.json.dumps(event, default=float) + "\n"
+
+    def _add(self, out, socket):
+        import queue
+        import threading
+        client = {'out': out, 'socket': socket, 'queue': queue.Queue(STREAM_QUEUE_LINES),
+                  'dropped': 0, 'written': 0, 'alive': True}
+        client['queue'].put(self.hello)
+        client['thread'] = threading.Thread(target=self._writer, args=(client,), daemon=True)
+        client['thread'].start()
+        with self.lock:
+            self.clients.append(client)
+
+    def _accept(self):
+        while True:
+            try:
+                conn, _ = self.server.accept()
+            except OSError:
+                return  # Server closed
+            self._add(conn.makefile('w'), socket=conn)
+
+    def _writer(self, client):
+        q = client['queue']
+        while True:
+            # Small batches, so a slow consumer frees queue slots steadily
+            batch = [q.get()]
+            while len(batch) < 64 and not q.empty():
+                batch.append(q.get_nowait())
+            done = batch[-1] is None
+            try:
+                client['out'].write(''.join(line for line in batch if line))
+                client['out'].flush()
+                client['written'] += len(batch)
+            except (OSError, ValueError):
+                done = True
+            if done:
+                self._drop(client)
+                return
+
+    def _drop(self, client):
+        client['alive'] = False
+        with self.lock:
+            if client in self.clients:
+                self.clients.remove(client)
+        if client['socket']:
+            try:
+                client['out'].close()
+                client['socket'].close()
+            except OSError:
+                pass
+
+    def emit(self, event, droppable=False):
+        import queue
+        line = self._line(event)
+        with self.lock:
+            clients = list(self.clients)
+        for client in clients:
+            q = client['queue']
+            if droppable and not self.lossless:
+                try:
+                    if client['dropped']:
+                        q.put_nowait(self._line({'type': 'dropped', 'blocks': client['dropped']}))
+                        client['dropped'] = 0
+                    q.put_nowait(line)
+                except queue.Full:
+                    client['dropped'] += 1
+                    self.lost += 1
+                continue
+            if client['dropped']:
+                line = self._line({'type': 'dropped', 'blocks': client['dropped']}) + line
+                client['dropped'] = 0
+            try:
+                q.put(line, timeout=STREAM_STALL_S if client['socket'] and not self.lossless else None)
+            except queue.Full:
+                print(f"⚠ Stream client stalled for {STREAM_STALL_S:.0f} s, disconnected", file=sys.stderr)
+                client['alive'] = False
+                self._drop(client)
+
+    def close(self, event):
+        """Send the final event to everyone, wait for the writers and shut down"""
+        self.emit(event)
+        with self.lock:
+            clients = list(self.clients)
+        for client in clients:
+            client['queue'].put(None)
+            if self.lossless or not client['socket']:
+                client['thread'].join()
+                continue
+            # Let slow clients drain as long as they keep making progress
+            written = None
+            while client['thread'].is_alive() and written != client['written']:
+                written = client['written']
+                client['thread'].join(timeout=STREAM_STALL_S)
+        if self.server:
+            self.server.close()
+            self.os.unlink(self.path)
+
+
+def tone_event(tone, index):
+    """'tone' stream event for a closed tone"""
+    return {'type': 'tone', 'index': index, 'start': round(tone['start'], 3), 'end': round(tone['end'], 3),
+            'duration': round(tone['duration'], 3), 'freq': round(float(tone['avg_freq']), 1),
+            'max_db': round(float(tone['max_db']), 2), 'avg_db': round(float(tone['avg_db']), 2),
+            'sones': tone['sones'], 'flags': tone['flags']}
+
+
+def sweep_event(results, unit=None, rank_by='score'):
+    """'sweep' stream event for one analyzed sweep"""
+    best = max(results, key=RANK_KEYS[rank_by]) if results else None
+    keys = ('expected_freq', 'detected_freq', 'max_db', 'avg_db', 'score', 'thd_pct', 'sones', 'flags')
+    return {'type': 'sweep', 'unit': unit, 'best_freq': best['expected_freq'] if best else None,
+            'results': [{k: r.get(k) for k in keys} for r in results or []]}
+
+
+def run_stream(args, device=None, source=None):
+    """Headless mode: stream block, tone and sweep events as JSON lines.
+
+    Sweep events come from the whole session's tones when it ends (input
+    exhausted, --duration, Ctrl+C) or, with --arm, one per captured unit.
+    Human-readable messages go to stderr.
+    """
+    reader = WavReader(args.input) if args.input else None
+    rate = reader.rate if reader else SAMPLE_RATE
+    make = lambda: SpectrumAnalyzer(sample_rate=rate, track=args.track, spl_offset=args.spl_offset,
+                                    denoise=args.denoise)
+    analyzer = make()
+    armed = ArmedRecorder(make, args.sweep) if args.arm else None
+
+    stream = JsonStream(args.stream, dict(recording_metadata(analyzer, args.input or source, args.sweep, args.firmware),
+                                          version=1), lossless=reader is not None)
+    segmenter = ToneSegmenter()
+    tones = []
+    blocks = 0
+    block_s = analyzer.block_size / rate
+
+    def feed(block):
+        nonlocal blocks
+        blocks += 1
+        t = blocks * block_s
+        freq, db = analyzer.process_audio(block)
+        stream.emit({'type': 'block', 't': round(t, 4), 'freq': round(float(freq), 1),
+                     'db': round(float(db), 2), 'rms_db': round(float(analyzer.rms_db), 2),
+                     'clipped': analyzer.clipped, 'sones': round(analyzer.sones, 3)}, droppable=True)
+        tone = segmenter.push((t, freq, db, analyzer.harmonics,
+                               {'sones': analyzer.sones, 'clipped': analyzer.clipped, 'dc': analyzer.dc_offset}))
+        if tone:
+            tones.append(tone)
+            stream.emit(tone_event(tone, len(tones)))
+        if armed:
+            rec = armed.feed(block)
+            if rec:
+                unit = armed_unit_id(args, armed.runs)
+                results = analyze_sweep(rec.recorded_peaks, score_weights=args.score_weights,
+                                        sweep=args.sweep, native=rec.native)
+                stream.emit(sweep_event(results, unit, args.rank_by))
+
+    start = time.time()
+    if reader:
+        for block in reader.blocks(BLOCK_SIZE, pad=True):
+            feed(block.mean(axis=1))
+    else:
+        import queue
+        incoming = queue.Queue()
+        running = True
+
+        def signal_handler(sig, frame):
+            nonlocal running
+            running = False
+
+        def audio_callback(indata, frames, time_info, status):
+            count_overflow(status)
+            incoming.put(indata[:, 0].copy())
+
+        signal.signal(signal.SIGINT, signal_handler)
+        signal.signal(signal.SIGTERM, signal_handler)
+        print(f"📡 Streaming to {'stdout' if args.stream == '-' else args.stream} (Ctrl+C to stop)", file=sys.stderr)
+        with sd.InputStream(samplerate=SAMPLE_RATE, channels=CHANNELS, blocksize=BLOCK_SIZE, device=device,
+                            callback=audio_callback):
+            while running and not (args.duration and time.time() - start > args.duration):
+                try:
+                    feed(incoming.get(timeout=0.1))
+                except queue.Empty:
+                    pass
+
+    tone = segmenter.flush()
+    if tone:
+        tones.append(tone)
+        stream.emit(tone_event(tone, len(tones)))
+    if not armed:
+        results = analyze_tones(tones, args.score_weights, args.sweep)
+        if results:
+            stream.emit(sweep_event(results, args.unit, args.rank_by))
+    elapsed = time.time() - start
+    stream.close({'type': 'end', 'blocks': blocks, 'tones': len(tones), 'dropped': stream.lost})
+    print(f"📡 {blocks} blocks, {len(tones)} tones streamed in {elapsed:.2f} s "
+          f"({blocks / max(elapsed, 1e-9):.0f} blocks/s)", file=sys.stderr)
+
+
+class CalibrationStation:
+    """One SpectrumAnalyzer per input channel, analyzed concurrently.
+
+    The audio callback only copies each multi-channel block into a queue;
+    a dispatcher thread hands the channels of every block to a thread
+    pool (NumPy's FFTs release the GIL) and waits for all of them before
+    the next block, so every pipeline sees the same sample-accurate
+    timestamps. A pipeline costs ~0.2 ms per 93 ms block, so 8 channels
+    use a few percent of the deadline; blocks whose processing overruns
+    it, and queue overflows, are counted rather than hidden. An exception
+    in a pipeline stops processing; the dispatcher keeps draining the
+    queue so feed() never hangs, and feed() and stop() raise it.
+    With publish=True every pipeline leaves its latest BlockSnapshot in
+    snapshots[channel], for a live display that never touches an
+    analyzer a worker is mutating.
+    """
+
+    def __init__(self, channels, sample_rate=SAMPLE_RATE, block_size=BLOCK_SIZE, workers=None, publish=False,
+                 **analyzer_kw):
+        import os
+        import queue
+        from concurrent.futures import ThreadPoolExecutor
+        self.channels = channels
+        self.sample_rate = sample_rate
+        self.block_size = block_size
+        self.analyzers = [SpectrumAnalyzer(sample_rate, block_size, **analyzer_kw) for _ in range(channels)]
+        self.pool = ThreadPoolExecutor(max_workers=workers or min(channels, os.cpu_count() or 1))
+        self.queue = queue.Queue(maxsize=STATION_QUEUE_BLOCKS)
+        self.blocks = 0
+        self.late = 0
+        self.dropped = 0
+        self.busy_s = 0.0
+        self.worst_s = 0.0
+        self.error = None  # First pipeline exception, re-raised by feed() and stop()
+        self.snapshots = [None] * channels if publish else None
+        self.thread = None
+
+    def start(self):
+        import threading
+        for analyzer in self.analyzers:
+            analyzer.start_recording()
+        self.thread = threading.Thread(target=self._dispatch, daemon=True)
+        self.thread.start()
+
+    def feed(self, block, wait=False):
+        """Queue one [frames, channels] block; wait=True blocks instead of dropping (files)"""
+        import queue
+        self._check()
+        try:
+            self.queue.put(np.array(block, dtype=np.float32), block=wait)
+        except queue.Full:
+            self.dropped += 1
+
+    def _check(self):
+        if self.error:
+            raise RuntimeError(f"station processing failed: {type(self.error).__name__}: {self.error}") \
+                from self.error
+
+    def _process(self, channel, block, timestamp):
+        analyzer = self.analyzers[channel]
+        analyzer.process_audio(block[:, channel], timestamp=timestamp)
+        if self.snapshots is not None:
+            self.snapshots[channel] = analyzer.snapshot()
+
+    def _dispatch(self):
+        deadline = self.block_size / self.sample_rate
+        while True:
+            block = self.queue.get()
+            if block is None:
+                break
+            if self.error:
+                continue  # Drain only, so a feed(wait=True) blocked on a full queue returns
+            self.blocks += 1
+            timestamp = self.blocks * self.block_size / self.sample_rate
+            t0 = time.perf_counter()
+            try:
+                list(self.pool.map(self._process, range(self.channels),
+                                   [block] * self.channels, [timestamp] * self.channels))
+            except Exception as e:
+                self.error = e
+                continue
+            took = time.perf_counter() - t0
+            self.busy_s += took
+            self.worst_s = max(self.worst_s, took)
+            if took > deadline:
+                self.late += 1
+
+    def stop(self):
+        """Drain the queue and return each channel's recorded peaks"""
+        self.queue.put(None)
+        self.thread.join()
+        self.pool.shutdown()
+        self._check()
+        return [analyzer.stop_recording() for analyzer in self.analyzers]
+
+    def load_str(self):
+        """Processing load summary"""
+        if not self.blocks:
+            return "no blocks"
+        deadline_ms = 1000 * self.block_size / self.sample_rate
+        mean_ms = 1000 * self.busy_s / self.blocks
+        return (f"{self.blocks} blocks, {mean_ms:.2f} ms mean / {1000 * self.worst_s:.2f} ms worst "
+                f"of {deadline_ms:.0f} ms ({100 * mean_ms / deadline_ms:.1f}% load), "
+                f"{self.late} late, {self.dropped} dropped")
+
+
+def run_station(station, units, args, source=None, device=None):
+    """Capture (or read --input) all channels, then report every unit at once"""
+    import io
+    from contextlib import redirect_stdout
+
+    print(f"\n🏭 CALIBRATION STATION - {station.channels} channels: {', '.join(units)}")
+    if source:
+        wav = WavReader(source)
+        if wav.channels < station.channels:
+            print(f"❌ {source} has {wav.channels} channel{'s' if wav.channels > 1 else ''}, "
+                  f"--station {station.channels} needs one per fixture")
+            return 1
+    station.start()
+    if source:
+        t0 = time.perf_counter()
+        try:
+            for block in wav.blocks(station.block_size, pad=True):
+                station.feed(block[:, :station.channels], wait=True)
+            peaks_per_channel = station.stop()
+        except RuntimeError as e:
+            print(f"❌ {e}")
+            return 1
+        took = time.perf_counter() - t0
+        print(f"   {wav.duration:.1f} s of audio in {took:.2f} s ({wav.duration / max(took, 1e-9):.0f}x real time)")
+    else:
+        print("   Power on all fixtures in calibration mode; Ctrl+C when the sweeps are done")
+        running = True
+
+        def signal_handler(sig, frame):
+            nonlocal running
+            running = False
+
+        def audio_callback(indata, frames, time_info, status):
+            count_overflow(status)
+            if not station.error:  # Never raise into PortAudio; stop() reports it
+                station.feed(indata)
+
+        old_handler = signal.signal(signal.SIGINT, signal_handler)
+        try:
+            with sd.InputStream(samplerate=station.sample_rate, channels=station.channels,
+                                blocksize=station.block_size, device=device, callback=audio_callback):
+                start = time.time()
+                print("\n" * station.channels, end="")
+                while running and not station.error:
+                    if args.duration and time.time() - start > args.duration:
+                        break
+                    # One line per channel, redrawn in place from the workers' snapshots
+                    lines = [f"\033[{station.channels}A"]
+                    for unit, snap in zip(units, station.snapshots):
+                        if snap is None:
+                            lines.append(f"\r  {unit:<12} waiting...\033[K\n")
+                            continue
+                        warnings = health_warnings(snap.clip_hold, snap.dc_offset)
+                        health = f" \033[91m⚠ {warnings}\033[0m" if warnings else ""
+                        lines.append(f"\r  {unit:<12} {snap.peak_freq:4.0f} Hz {snap.peak_db:6.1f} dB "
+                                     f"[{spectrum_bar(snap.smoothed, 30)}]{health}\033[K\n")
+                    print("".join(lines), end="", flush=True)
+                    time.sleep(0.2)
+        finally:
+            signal.signal(signal.SIGINT, old_handler)
+        try:
+            peaks_per_channel = station.stop()
+        except RuntimeError as e:
+            print(f"\n❌ {e}")
+            return 1
+    print(f"   Load: {station.load_str()}")
+
+    output = Path(args.output or default_output_file())
+    db = UnitDatabase(args.db) if args.db else None
+    if source:
+        run_date, build = recording_origin(source)
+        firmware = args.firmware or build or UNKNOWN_FIRMWARE
+    else:
+        run_date, firmware = None, args.firmware or firmware_build()
+
+    print("\n" + "=" * 78)
+    print(f"{'Ch':>3} {'Unit':<14} {'Tones':>6} {'Best (Hz)':>10} {'Max dB':>8} {'Score':>7} {'Detected':>9}  Flags")
+    print("-" * 78)
+    for ch, (unit, analyzer, peaks) in enumerate(zip(units, station.analyzers, peaks_per_channel), 1):
+        with redirect_stdout(io.StringIO()):
+            results = analyze_sweep(peaks, score_weights=args.score_weights, sweep=args.sweep,
+                                    native=analyzer.native)
+            csv_path = output.with_name(f"{output.stem}_{unit}.csv")
+            if results:
+                print_results(results, str(csv_path), rank_by=args.rank_by)
+        if not results:
+            print(f"{ch:>3} {unit:<14} {'-':>6} {'no sweep detected':>36}")
+            continue
+        best = max(results, key=RANK_KEYS[args.rank_by])
+        flags = ",".join(sorted({f for r in results for f in r.get('flags', [])}))
+        print(f"{ch:>3} {unit:<14} {len(results):>6} {best['expected_freq']:>10.0f} {best['max_db']:>8.1f} "
+              f"{RANK_KEYS['score'](best):>7.1f} {best['detected_freq']:>9.0f}  {flags}")
+        if db:
+            modes = fit_modes(results, spectral_mode_centers(peaks, analyzer.buzzer_freqs))
+            db.add_run(unit, firmware, results, modes, source=str(Path(source).resolve()) if source else "station",
+                       run_date=run_date, rank_by=args.rank_by, imported=bool(source))
+    print("=" * 78)
+    print(f"📁 Per-unit results: {output.with_name(output.stem + '_<unit>.csv')}")
+    if db:
+        print(f"🗄️  {db.flush()} runs stored in {args.db}{db.skipped_str()}")
+        db.close()
+
+
+def batch_unit(path, rank_by='score', score_weights=SCORE_WEIGHTS, track=False, denoise=False, sweep=None,
+               profile=False):
+    """Analyze one unit's recording (.wav/.bzr) or results CSV for --batch.
+
+    Runs in a worker process, so it returns a plain summary dict and keeps
+    the per-unit report off the terminal. sweep (--sweep-table) defaults
+    to the one stored in a .bzr, else stock firmware. profile=True times
+    the file on a fresh StageProfiler and returns its state() as 'profile'.
+    """
+    import io
+    from contextlib import redirect_stdout
+    global PROFILER
+    PROFILER = StageProfiler() if profile else None  # Never the parent's hub, even when forked
+    path = Path(path)
+    unit = path.stem.replace('buzzer_analysis_', '')
+    summary = {'unit': unit, 'path': str(path), 'tones': 0, 'best_freq': None, 'best_db': None,
+               'best_score': None, 'modes': [], 'error': None, 'results': [], 'fitted_modes': [],
+               'expected': len(sweep or sweep_frequencies()), 'seconds': 0.0,
+               'run_date': None, 'firmware': None}
+    t0 = time.process_time()  # CPU time, so workers sharing a core don't inflate it
+    try:
+        summary['run_date'], summary['firmware'] = recording_origin(path)
+        with redirect_stdout(io.StringIO()), np.errstate(all='ignore'):
+            centers = None
+            if path.suffix == '.csv':
+                results = load_results_csv(path)
+            else:
+                if path.suffix == '.bzr':
+                    rec = RecordingReader(path)
+                    analyzer = SpectrumAnalyzer(sample_rate=rec.metadata['sample_rate'],
+                                                block_size=rec.metadata['block_size'])
+                    peaks = rec.peaks()
+                    sweep = sweep or rec.metadata.get('firmware', {}).get('sweep')
+                    summary['expected'] = len(sweep or sweep_frequencies())
+                else:
+                    analyzer = SpectrumAnalyzer(sample_rate=WavReader(path).rate, track=track, denoise=denoise)
+                    peaks = analyze_wav(analyzer, path)
+                results = analyze_sweep(peaks, score_weights=score_weights, sweep=sweep, native=analyzer.native)
+                centers = spectral_mode_centers(peaks, analyzer.buzzer_freqs) if results else None
+            modes = fit_modes(results, centers) if results else []
+    except Exception as e:
+        summary['error'] = f"{type(e).__name__}: {e}"
+        return summary
+    finally:
+        summary['seconds'] = time.process_time() - t0
+        if PROFILER:
+            summary['profile'] = PROFILER.state()
+
+    if not results:
+        summary['error'] = "no sweep detected"
+        return summary
+    best = max(results, key=RANK_KEYS[rank_by])
+    summary.update(tones=len(results), best_freq=best['expected_freq'], best_db=best['max_db'],
+                   best_score=RANK_KEYS['score'](best),
+                   modes=[(m['center'], m['gain_db']) for m in modes if m['gain_db'] >= FLEET_MIN_GAIN_DB],
+                   results=[{k: v for k, v in r.items() if not isinstance(v, dict)} for r in results],
+                   fitted_modes=[{k: m[k] for k in ('center', 'q', 'gain_db')} for m in modes])
+    return summary
+
+
+def _robust_outliers(values, min_sigma):
+    """Indices whose median/MAD z-score exceeds FLEET_OUTLIER_Z, and (median, sigma)"""
+    values = np.asarray(values, dtype=float)
+    median = np.median(values)
+    sigma = max(1.4826 * np.median(np.abs(values - median)), min_sigma)
+    return np.flatnonzero(np.abs(values - median) / sigma > FLEET_OUTLIER_Z), median, sigma
+
+
+def fleet_mode_map(units):
+    """Aggregate batch_unit() summaries: mode clusters and outlier reasons per unit"""
+    ok = [u for u in units if not u['error']]
+    outliers = {u['unit']: [u['error']] for u in units if u['error']}
+
+    # Sweeps with missing tones are mapped by order, so their frequencies may be shifted
+    for u in ok:
+        if u['tones'] < u['expected']:
+            outliers.setdefault(u['unit'], []).append(f"{u['tones']}/{u['expected']} tones, mapping uncertain")
+
+    # Fleet modes: density peaks of all units' centers (10 Hz kernel)
+    points = sorted((c, u['unit']) for u in ok for c, _ in u['modes'])
+    seeds = []
+    if points:
+        centers = np.array([c for c, _ in points])
+        grid = np.arange(centers.min() - FLEET_MODE_GAP_HZ, centers.max() + FLEET_MODE_GAP_HZ)
+        density = np.exp(-0.5 * ((grid[:, None] - centers[None, :]) / (FLEET_MODE_GAP_HZ / 4)) ** 2).sum(axis=1)
+        support = FLEET_MODE_SUPPORT * len(ok)
+        seeds = [grid[i] for i in range(1, len(grid) - 1)
+                 if density[i] >= density[i - 1] and density[i] > density[i + 1] and density[i] >= support]
+    clusters = [[] for _ in seeds]
+    for c, unit in points:
+        nearest = int(np.argmin([abs(c - s0) for s0 in seeds])) if seeds else None
+        if nearest is None or abs(c - seeds[nearest]) > FLEET_MODE_GAP_HZ:
+            outliers.setdefault(unit, []).append(f"extra mode at {c:.0f} Hz")
+        else:
+            clusters[nearest].append((c, unit))
+    mode_map = []
+    for cluster in clusters:
+        if not cluster:
+            continue
+        centers = [c for c, _ in cluster]
+        idx, median, sigma = _robust_outliers(centers, FLEET_MIN_SIGMA_HZ)
+        for i in idx:
+            c, unit = cluster[i]
+            outliers.setdefault(unit, []).append(f"mode at {c:.0f} Hz (fleet {median:.0f} Hz)")
+        mode_map.append({'median': median, 'std': float(np.std(centers)), 'min': min(centers),
+                         'max': max(centers), 'units': len({u for _, u in cluster}), 'centers': centers})
+
+    if ok:
+        idx, median, _ = _robust_outliers([u['best_freq'] for u in ok], FREQ_STEP / 2)
+        for i in idx:
+            outliers.setdefault(ok[i]['unit'], []).append(
+                f"best {ok[i]['best_freq']:.0f} Hz (fleet {median:.0f} Hz)")
+    return mode_map, outliers
+
+
+def print_fleet(units, mode_map, outliers, output_file=None):
+    """Print the fleet mode map and optionally save per-unit rows as CSV"""
+    ok = [u for u in units if not u['error']]
+    print("\n" + "=" * 70)
+    print(f"FLEET MODE MAP - {len(ok)} of {len(units)} units analyzed")
+    print("=" * 70)
+
+    print(f"\n{'Unit':<24} {'Best (Hz)':>9} {'Max dB':>8} {'Score':>7}  Modes (Hz)")
+    print("-" * 70)
+    for u in units:
+        if u['error']:
+            print(f"{u['unit']:<24} {'-':>9} {'-':>8} {'-':>7}  ❌ {u['error']}")
+            continue
+        modes = " ".join(f"{c:.0f}" for c, _ in u['modes'])
+        marker = " ⚠" if u['unit'] in outliers else ""
+        print(f"{u['unit']:<24} {u['best_freq']:>9.0f} {u['best_db']:>8.1f} {u['best_score']:>7.1f}  {modes}{marker}")
+
+    if ok:
+        counts = {}
+        for u in ok:
+            counts[u['best_freq']] = counts.get(u['best_freq'], 0) + 1
+        print("\n🏆 Best frequency across the fleet:")
+        for freq in sorted(counts):
+            print(f"  {freq:6.0f} Hz {'█' * counts[freq]} {counts[freq]}")
+
+    if mode_map:
+        print("\n🎯 Mode centers:")
+        print(f"  {'Median':>8} {'Std':>6} {'Range':>13} {'Units':>6}")
+        for m in mode_map:
+            print(f"  {m['median']:>8.0f} {m['std']:>6.1f} {m['min']:>6.0f}-{m['max']:<6.0f} {m['units']:>6}")
+
+    if outliers:
+        print("\n⚠️  Outliers:")
+        for unit in sorted(outliers):
+            print(f"  {unit}: {'; '.join(outliers[unit])}")
+    print("=" * 70)
+
+    if output_file:
+        import csv
+        with open(output_file, 'w', newline='') as f:
+            writer = csv.writer(f)
+            writer.writerow(['unit', 'path', 'tones', 'best_freq', 'best_db', 'best_score',
+                             'mode_centers', 'outlier'])
+            for u in units:
+                writer.writerow([u['unit'], u['path'], u['tones'], u['best_freq'], u['best_db'],
+                                 u['best_score'], ";".join(f"{c:.1f}" for c, _ in u['modes']),
+                                 "; ".join(outliers.get(u['unit'], []))])
+        print(f"\n📁 Fleet map saved to: {output_file}")
+
+
+def run_batch(directory, args):
+    """Analyze every recording/results file in a directory in parallel"""
+    import os
+    from concurrent.futures import ProcessPoolExecutor
+    from functools import partial
+
+    # CSVs by header: fleet maps (-o), mode tables and other exports sharing the directory are skipped
+    paths = sorted(p for p in Path(directory).iterdir()
+                   if p.suffix in ('.wav', '.bzr') or (p.suffix == '.csv' and is_results_csv(p)))
+    if not paths:
+        print(f"❌ No .wav, .bzr or results .csv files in {directory}")
+        return 1
+    cores = os.cpu_count() or 1
+    jobs = args.jobs or cores
+
+    print(f"\n🏭 Analyzing {len(paths)} files on {jobs} worker{'s' if jobs > 1 else ''}...")
+    t0 = time.perf_counter()
+    work = partial(batch_unit, rank_by=args.rank_by, score_weights=args.score_weights,
+                   track=args.track, denoise=args.denoise, sweep=args.sweep, profile=PROFILER is not None)
+    units = []
+    with ProcessPoolExecutor(max_workers=jobs) as pool:
+        # One file per task: recordings are big enough that dispatch cost doesn't matter
+        for i, summary in enumerate(pool.map(work, paths), 1):
+            if 'profile' in summary:
+                PROFILER.absorb(summary.pop('profile'))
+            units.append(summary)
+            print(f"\r  {i}/{len(paths)} {summary['unit']}\033[K", end="", flush=True)
+    # Summed per-file CPU time over wall time: the speedup the workers actually delivered
+    wall = time.perf_counter() - t0
+    busy = sum(u['seconds'] for u in units)
+    print(f"\r  {len(paths)} files in {wall:.1f} s ({busy:.1f} s CPU, {busy / max(wall, 1e-9):.1f}x "
+          f"on {jobs} worker{'s' if jobs > 1 else ''}, {cores} core{'s' if cores > 1 else ''})\033[K")
+
+    mode_map, outliers = fleet_mode_map(units)
+    print_fleet(units, mode_map, outliers, args.output)
+
+    if args.db:
+        # Each run keeps its recording's own date and build, and a directory imported twice adds nothing
+        db = UnitDatabase(args.db)
+        for u in units:
+            if not u['error']:
+                db.add_run(u['unit'], args.firmware or u['firmware'] or UNKNOWN_FIRMWARE, u['results'],
+                           u['fitted_modes'], source=str(Path(u['path']).resolve()), run_date=u['run_date'],
+                           rank_by=args.rank_by, imported=True)
+        print(f"🗄️  {db.flush()} runs stored in {args.db}{db.skipped_str()}")
+        db.close()
+
+
+def firmware_build():
+    """Short content hash of the firmware sources, used when --firmware isn't given"""
+    import hashlib
+    digest = hashlib.sha1()
+    for name in FIRMWARE_SOURCES:
+        path = Path(__file__).with_name(name)
+        if path.exists():
+            digest.update(name.encode() + path.read_bytes())
+    return digest.hexdigest()[:10]
+
+
+def best_mode(results, modes, rank_by='score'):
+    """Center of the fitted mode nearest the best drive frequency (or its detected frequency)"""
+    best = max(results, key=RANK_KEYS[rank_by])
+    if not modes:
+        return best['detected_freq']
+    return min((m['center'] for m in modes), key=lambda c: abs(c - best['detected_freq']))
+
+
+class UnitDatabase:
+    """SQLite calibration history keyed by unit ID, firmware build and date.
+
+    add_run() only queues; flush() writes all queued runs with their
+    per-frequency results and fitted modes in one transaction, so a batch
+    of thousands costs one commit and nothing touches the disk while
+    audio is being recorded. Runs are indexed by unit/date, firmware,
+    best frequency and best mode; mode centers have their own index.
+    Imported runs (analyzed from a recording file) are stored once per
+    unit and source file: flush() skips them when already present.
+    """
+
+    SCHEMA = """
+        CREATE TABLE IF NOT EXISTS runs (
+            id INTEGER PRIMARY KEY,
+            unit_id TEXT NOT NULL,
+            firmware TEXT NOT NULL,
+            run_date TEXT NOT NULL,
+            source TEXT,
+            tones INTEGER,
+            best_freq REAL,
+            best_db REAL,
+            best_score REAL,
+            best_mode REAL
+        );
+        CREATE TABLE IF NOT EXISTS results (
+            run_id INTEGER NOT NULL REFERENCES runs(id),
+            expected_freq REAL, detected_freq REAL, max_db REAL, avg_db REAL,
+            score REAL, sones REAL, thd_pct REAL
+        );
+        CREATE TABLE IF NOT EXISTS modes (
+            run_id INTEGER NOT NULL REFERENCES runs(id),
+            center REAL, q REAL, gain_db REAL
+        );
+        CREATE INDEX IF NOT EXISTS runs_unit_date ON runs(unit_id, run_date);
+        CREATE INDEX IF NOT EXISTS runs_firmware ON runs(firmware, run_date);
+        CREATE INDEX IF NOT EXISTS runs_best_freq ON runs(best_freq);
+        CREATE INDEX IF NOT EXISTS runs_best_mode ON runs(best_mode);
+        CREATE INDEX IF NOT EXISTS runs_source ON runs(source, unit_id);
+        CREATE INDEX IF NOT EXISTS results_run ON results(run_id);
+        CREATE INDEX IF NOT EXISTS modes_run ON modes(run_id);
+        CREATE INDEX IF NOT EXISTS modes_center ON modes(center);
+    """
+
+    COLUMNS = ('id', 'unit_id', 'firmware', 'run_date', 'source', 'tones',
+               'best_freq', 'best_db', 'best_score', 'best_mode')
+
+    def __init__(self, path=UNIT_DB):
+        import sqlite3
+        self.path = str(path)
+        self.conn = sqlite3.connect(self.path)
+        self.conn.execute("PRAGMA journal_mode=WAL")
+        self.conn.execute("PRAGMA synchronous=NORMAL")
+        self.conn.executescript(self.SCHEMA)
+        self.pending = []
+        self.skipped = 0
+
+    def add_run(self, unit_id, firmware, results, modes=(), source=None, run_date=None, rank_by='score',
+                imported=False):
+        """Queue one analyzed run (analyze_sweep() results and fit_modes() modes).
+
+        run_date defaults to now (a live run). imported=True marks a run
+        analyzed from the recording file source, stored only once.
+        """
+        if not results:
+            return
+        best = max(results, key=RANK_KEYS[rank_by])
+        run = (unit_id, firmware, run_date or datetime.now().isoformat(timespec='seconds'), source,
+               len(results), best['expected_freq'], best['max_db'], RANK_KEYS['score'](best),
+               best_mode(results, modes, rank_by))
+        rows = [(r['expected_freq'], r['detected_freq'], r['max_db'], r['avg_db'],
+                 r.get('score'), r.get('sones'), r.get('thd_pct')) for r in results]
+        mode_rows = [(m['center'], m.get('q'), m.get('gain_db')) for m in modes]
+        self.pending.append((run, rows, mode_rows, imported))
+
+    def flush(self):
+        """Write all queued runs in a single transaction; returns how many (skipped: see .skipped)"""
+        pending, self.pending = self.pending, []
+        stored = 0
+        with self.conn:
+            for run, rows, mode_rows, imported in pending:
+                if imported and self.conn.execute("SELECT 1 FROM runs WHERE source = ? AND unit_id = ?",
+                                                  (run[3], run[0])).fetchone():
+                    self.skipped += 1
+                    continue
+                stored += 1
+                run_id = self.conn.execute(
+                    "INSERT INTO runs (unit_id, firmware, run_date, source, tones, best_freq, "
+                    "best_db, best_score, best_mode) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)", run).lastrowid
+                self.conn.executemany("INSERT INTO results VALUES (?, ?, ?, ?, ?, ?, ?, ?)",
+                                      [(run_id,) + r for r in rows])
+                self.conn.executemany("INSERT INTO modes VALUES (?, ?, ?, ?)",
+                                      [(run_id,) + m for m in mode_rows])
+        return stored
+
+    def skipped_str(self):
+        return f" ({self.skipped} already stored)" if self.skipped else ""
+
+    def query(self, where="1", params=(), latest=False):
+        """Runs matching an SQL condition on runs columns, newest first.
+
+        latest=True keeps only each unit's most recent run.
+        """
+        sql = f"SELECT {', '.join(self.COLUMNS)} FROM runs WHERE ({where})"
+        if latest:
+            sql += (" AND run_date = (SELECT MAX(r2.run_date) FROM runs r2"
+                    " WHERE r2.unit_id = runs.unit_id)")
+        sql += " ORDER BY run_date DESC"
+        return [dict(zip(self.COLUMNS, row)) for row in self.conn.execute(sql, params)]
+
+    def close(self):
+        if self.pending:
+            self.flush()
+        self.conn.close()
+
+
+def print_runs(runs, title):
+    """Table of database runs"""
+    print(f"\n🗄️  {title}: {len(runs)} run{'s' if len(runs) != 1 else ''}")
+    if not runs:
+        return
+    print("-" * 86)
+    print(f"{'Unit':<16} {'Date':<20} {'Firmware':<11} {'Best (Hz)':>9} {'Mode (Hz)':>9} "
+          f"{'Max dB':>7} {'Tones':>6}")
+    print("-" * 86)
+    for r in runs:
+        print(f"{r['unit_id']:<16} {r['run_date']:<20} {r['firmware']:<11} {r['best_freq']:>9.0f} "
+              f"{r['best_mode']:>9.0f} {r['best_db']:>7.1f} {r['tones']:>6}")
+
+
+def default_output_file():
+    timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
+    return f"buzzer_analysis_{timestamp}.csv"
+
+
+def report_sweep(analyzer, peaks, args):
+    """Analyze recorded sweep peaks and print/save results (live or --input)"""
+    results = analyze_sweep(peaks, score_weights=args.score_weights, sweep=args.sweep, native=analyzer.native)
+
+    output_file = args.output or default_output_file()
+    print_results(results, output_file, rank_by=args.rank_by)
+
+    if args.onsets:
+        print_onsets(analyzer.get_recorded_audio(), analyzer.sample_rate, detect_tones(peaks, native=analyzer.native))
+
+    modes = []
+    if results and (args.fit_modes or args.db):
+        modes = fit_modes(results, spectral_mode_centers(peaks, analyzer.buzzer_freqs))
+    if args.fit_modes and results:
+        print_modes(modes, str(Path(output_file).with_name(Path(output_file).stem + '_modes.csv')))
+        if modes and args.write_header:
+            write_calib_header(modes)
+
+    if results and args.db:
+        unit = args.unit or (Path(args.input).stem if args.input else "unknown")
+        db = UnitDatabase(args.db)
+        if args.input:
+            run_date, build = recording_origin(args.input)
+            db.add_run(unit, args.firmware or build or UNKNOWN_FIRMWARE, results, modes,
+                       source=str(Path(args.input).resolve()), run_date=run_date, rank_by=args.rank_by,
+                       imported=True)
+        else:
+            db.add_run(unit, args.firmware or firmware_build(), results, modes, source="live",
+                       rank_by=args.rank_by)
+        if db.flush():
+            print(f"🗄️  Run stored for unit {unit} in {args.db}")
+        else:
+            print(f"🗄️  Run of unit {unit} from {args.input} already stored in {args.db}")
+        db.close()
+
+
+def score_weights_arg(text):
+    """argparse type for --score-weights: three comma-separated floats"""
+    try:
+        weights = tuple(float(w) for w in text.split(','))
+    except ValueError:
+        weights = ()
+    if len(weights) != 3:
+        raise argparse.ArgumentTypeError(f"expected three numbers fund,harm,count, got '{text}'")
+    return weights
 
 
 def main():
@@ -572,6 +4644,7 @@ Examples:
   python buzzer_analyzer.py              # Live monitoring
   python buzzer_analyzer.py --record     # Record calibration sweep
   python buzzer_analyzer.py --record -o results.csv  # Save to file
+  python buzzer_analyzer.py -i sweep.wav -o results.csv  # Analyze a recording
         """
     )
 
@@ -581,6 +4654,107 @@ Examples:
                         help='Output CSV file for results')
     parser.add_argument('--duration', '-d', type=float, default=None,
                         help='Recording/monitoring duration in seconds')
+    parser.add_argument('--track', action='store_true',
+                        help='Track fundamental across blocks (Kalman, rejects outliers)')
+    parser.add_argument('--score-weights', type=score_weights_arg, default=SCORE_WEIGHTS,
+                        help='Audibility score weights: fund,harm,count (default %s)'
+                             % ','.join(str(w) for w in SCORE_WEIGHTS))
+    parser.add_argument('--rank-by', choices=sorted(RANK_KEYS), default='score',
+                        help='Rank sweep candidates by score, max dB or loudness (sones)')
+    parser.add_argument('--spl-offset', type=float, default=LOUDNESS_SPL_OFFSET_DB,
+                        help='dB SPL of a full-scale sine, for absolute loudness '
+                             '(default %(default)s)')
+    parser.add_argument('--fit-modes', action='store_true',
+                        help='Fit resonance modes (center, Q, gain) after recording')
+    parser.add_argument('--fit-csv', type=str, default=None, metavar='CSV',
+                        help='Fit resonance modes from a saved results CSV')
+    parser.add_argument('--write-header', action='store_true',
+                        help='Write fitted modes to calib_modes.h for the firmware')
+    parser.add_argument('--sweep-table', nargs='?', const=str(CALIB_HEADER), default=None, metavar='HEADER',
+                        help='Units run firmware built with this calib_modes.h (default %s): map tones '
+                             'to its mode table instead of the stock 100 Hz sweep' % CALIB_HEADER.name)
+    parser.add_argument('--denoise', action='store_true',
+                        help='Suppress motor/prop noise (learns profile for the first %.0f s)'
+                             % NOISE_LEARN_S)
+    parser.add_argument('--onsets', action='store_true',
+                        help='Keep raw audio and report sub-ms onset, rise and settling per tone')
+    parser.add_argument('--latency', action='store_true',
+                        help='Stereo latency mode: BUZ- logic on one channel, mic on the other')
+    parser.add_argument('--input', '-i', type=str, default=None, metavar='WAV',
+                        help='Analyze a WAV file instead of live input (sweep analysis, '
+                             'or the latency/find/search/decode-ids/drift/beeper modes)')
+    parser.add_argument('--save-rec', type=str, default=None, metavar='BZR',
+                        help='Also save per-block peaks and spectra as a compressed .bzr recording '
+                             '(--record or --input); re-analyze later with --input file.bzr')
+    parser.add_argument('--batch', type=str, default=None, metavar='DIR',
+                        help='Analyze all recordings/results CSVs in DIR in parallel into a fleet mode map')
+    parser.add_argument('--jobs', '-j', type=int, default=None,
+                        help='Worker processes for --batch (default: all cores)')
+    parser.add_argument('--stream', nargs='?', const='-', metavar='SOCKET',
+                        help='Headless mode: stream block, tone and sweep events as JSON lines to stdout '
+                             '(or to clients of the Unix socket SOCKET); all other output goes to stderr')
+    parser.add_argument('--arm', action='store_true',
+                        help='Armed recording: start on the calibration intro beeps (with pre-trigger), '
+                             'stop after one sweep, re-arm for the next unit')
+    parser.add_argument('--station', type=int, default=None, metavar='N',
+                        help='Calibration station: analyze N input channels (one fixture each) concurrently')
+    parser.add_argument('--units', type=str, default=None,
+                        help='Comma-separated unit IDs for --station channels (default ch1..chN)')
+    parser.add_argument('--unit', type=str, default=None,
+                        help='Unit ID stored with the run (default: input file name, or "unknown")')
+    parser.add_argument('--firmware', type=str, default=None,
+                        help='Firmware build stored with the run (default: hash of main.c/calib_modes.h)')
+    parser.add_argument('--db', nargs='?', const=str(UNIT_DB), default=None, metavar='PATH',
+                        help='Store analyzed runs in the calibration history database (default %s); '
+                             '--query/--history read it' % UNIT_DB.name)
+    parser.add_argument('--query', type=str, default=None, metavar='SQL',
+                        help='List runs matching a condition on runs columns, e.g. "best_mode < 2450"')
+    parser.add_argument('--latest', action='store_true',
+                        help='With --query: only the latest run of each unit')
+    parser.add_argument('--history', type=str, default=None, metavar='UNIT',
+                        help='List all stored runs of a unit')
+    parser.add_argument('--recover', type=str, default=None, metavar='JSONL',
+                        help='Rebuild results from the tone log of an interrupted --record')
+    parser.add_argument('--span', type=str, default=None, metavar='T0,T1',
+                        help='Only analyze this time span (seconds) of a .bzr recording')
+    parser.add_argument('--logic-channel', type=int, choices=(0, 1), default=0,
+                        help='Channel carrying the BUZ- signal (default 0, mic on the other)')
+    parser.add_argument('--logic-invert', action='store_true',
+                        help='BUZ- signal is inverted by the input stage')
+    parser.add_argument('--mic-distance', type=float, default=10.0,
+                        help='Buzzer-to-mic distance in cm, subtracted as propagation delay')
+    parser.add_argument('--find', action='store_true',
+                        help='Stereo direction finder: bearing to the beeping buzzer')
+    parser.add_argument('--freq', type=float, default=INTRO_FREQ,
+                        help='Calibrated buzzer frequency for --find (default %(default)s Hz)')
+    parser.add_argument('--mic-spacing', type=float, default=FIND_MIC_SPACING_M * 100,
+                        help='Stereo mic spacing in cm for --find (default %(default)s)')
+    parser.add_argument('--search', action='store_true',
+                        help='Matched-filter search of a long --input recording for faint beeps')
+    parser.add_argument('--cadence', type=str, default=None, metavar='ON,OFF',
+                        help='Beep cadence in ms for --search (default %d,%d)' % SEARCH_CADENCE_MS)
+    parser.add_argument('--search-threshold', type=float, default=SEARCH_THRESHOLD_SIGMA,
+                        help='Detection threshold in noise sigmas for --search (default %(default)s)')
+    parser.add_argument('--decode-ids', action='store_true',
+                        help='Decode identity-coded beacons (firmware unit ID) from the mic or --input')
+    parser.add_argument('--beeper', action='store_true',
+                        help='Decode Betaflight beeper events (arming, RX lost, low battery...) '
+                             'in the live monitor or --input')
+    parser.add_argument('--engine', choices=['numpy', 'native'], default='numpy',
+                        help='DSP engine: NumPy reference or the SIMD C kernels of dsp_core.c '
+                             "(build with 'make dsp') (default: numpy)")
+    parser.add_argument('--profile', nargs='?', const=True, metavar='JSON',
+                        help='Time every analysis stage and count deadline misses; '
+                             'prints a summary at exit (and saves it to JSON if given)')
+    parser.add_argument('--spectrum-rows', type=int, default=0, metavar='N',
+                        help='Live monitor: add an N-row spectrum graph under the status line')
+    parser.add_argument('--waterfall', type=int, default=0, metavar='N',
+                        help='Live monitor: add a waterfall of the last N blocks')
+    parser.add_argument('--drift', action='store_true',
+                        help='Oscillator drift study: sub-Hz tone tracking, drift rate, Allan deviation, '
+                             'time in each mode (mic or --input; -o logs per-second frequency)')
+    parser.add_argument('--modes', type=str, metavar='CSV',
+                        help='Mode table for --drift (saved by --fit-modes); default PIEZO_MODES')
     parser.add_argument('--list-devices', action='store_true',
                         help='List available audio input devices')
     parser.add_argument('--device', '-D', type=int, default=None,
@@ -588,6 +4762,30 @@ Examples:
 
     args = parser.parse_args()
 
+    if args.stream == '-':
+        sys.stdout = sys.stderr  # stdout carries JSON lines only
+
+    args.sweep = None  # None: stock sweep, or the one stored with a .bzr / tone log
+    if args.sweep_table:
+        try:
+            args.sweep = sweep_frequencies(args.sweep_table)
+        except (OSError, ValueError) as e:
+            print(f"❌ --sweep-table: {e}")
+            return 1
+
+    if args.engine == 'native':
+        global NATIVE
+        NATIVE = NativeDSP.load()
+        if NATIVE is None:
+            print(f"❌ Native engine not built: run 'make dsp' to build {DSP_LIB.name}")
+            return 1
+
+    if args.profile:
+        import atexit
+        global PROFILER
+        PROFILER = StageProfiler()
+        atexit.register(PROFILER.report, None if args.profile is True else args.profile)
+
     if args.list_devices:
         print("\n📱 Available audio INPUT devices:")
         print("-" * 50)
@@ -599,6 +4797,115 @@ Examples:
         print("\nUsage: python buzzer_analyzer.py -D <index>")
         return
 
+    if args.latency and args.input:
+        rate, audio = read_wav(args.input)
+        print(f"\n  {args.input}: {len(audio) / rate:.1f} s, {audio.shape[1]} ch, {rate} Hz")
+        print_latency(*measure_latency(audio, rate, args.logic_channel,
+                                       args.mic_distance / 100, args.logic_invert))
+        return
+    if args.search:
+        if not args.input:
+            print("❌ --search needs --input <recording.wav>")
+            return 1
+        cadence = SEARCH_CADENCE_MS
+        if args.cadence:
+            cadence = tuple(float(v) for v in args.cadence.split(','))
+        search_recording(args.input, args.freq, cadence, args.search_threshold)
+        return
+    modes = load_modes_csv(args.modes) if args.modes else None
+    if args.beeper and args.input:
+        decode_beeper_wav(args.input)
+        return
+    if args.drift and args.input:
+        drift_wav(args.input, modes, args.output)
+        return
+    if args.decode_ids and args.input:
+        decode_ids_wav(args.input)
+        return
+    if args.find and args.input:
+        rate, audio = read_wav(args.input)
+        if audio.shape[1] < 2:
+            print("❌ --find needs a stereo recording")
+            return 1
+        find_in_wav(audio, rate, args.freq, args.mic_spacing / 100)
+        return
+    if args.stream and args.input:
+        run_stream(args)
+        return
+    if args.arm and args.input:
+        run_armed(args)
+        return
+    if args.station:
+        units = args.units.split(',') if args.units else [f"ch{i + 1}" for i in range(args.station)]
+        if len(units) != args.station:
+            print(f"❌ --units lists {len(units)} IDs for {args.station} channels")
+            return 1
+        if args.input:
+            rate = WavReader(args.input).rate
+            station = CalibrationStation(args.station, sample_rate=rate, track=args.track, denoise=args.denoise)
+            return run_station(station, units, args, source=args.input)
+    if args.input and args.input.endswith('.bzr'):
+        # Re-analysis of stored peaks and spectra, no audio needed
+        rec = RecordingReader(args.input)
+        meta = rec.metadata
+        args.sweep = args.sweep or meta.get('firmware', {}).get('sweep')
+        t0, t1 = (float(v) for v in args.span.split(',')) if args.span else (None, None)
+        print(f"\n📦 {args.input}: {rec.blocks} blocks in {len(rec.chunks)} chunks, "
+              f"{meta['sample_rate']} Hz, recorded {meta.get('created', '?')} from {meta.get('source', '?')}")
+        analyzer = SpectrumAnalyzer(sample_rate=meta['sample_rate'], block_size=meta['block_size'])
+        peaks = rec.peaks(t0, t1)
+        if not peaks:
+            print("❌ No blocks in the requested span")
+            return 1
+        if args.onsets:
+            print("⚠️  --onsets needs raw audio, not available from a .bzr recording")
+            args.onsets = False
+        report_sweep(analyzer, peaks, args)
+        return
+    if args.input:
+        # Offline sweep analysis: same pipeline as --record, fed from the file
+        analyzer = SpectrumAnalyzer(sample_rate=WavReader(args.input).rate, track=args.track,
+                                    spl_offset=args.spl_offset, denoise=args.denoise,
+                                    keep_audio=args.onsets)
+        if args.save_rec:
+            analyzer.recorder = RecordingWriter(args.save_rec, recording_metadata(analyzer, args.input, args.sweep,
+                                                                                  args.firmware))
+        peaks = analyze_wav(analyzer, args.input)
+        if analyzer.recorder:
+            analyzer.recorder.close()
+        if not peaks:
+            print("❌ Empty recording")
+            return 1
+        report_sweep(analyzer, peaks, args)
+        return
+
+    if args.query or args.history:
+        db = UnitDatabase(args.db or UNIT_DB)
+        t0 = time.perf_counter()
+        if args.history:
+            runs, title = db.query("unit_id = ?", (args.history,)), f"History of {args.history}"
+        else:
+            runs, title = db.query(args.query, latest=args.latest), f"Runs where {args.query}"
+        took = (time.perf_counter() - t0) * 1000
+        print_runs(runs, title)
+        print(f"\n  Query took {took:.1f} ms")
+        db.close()
+        return
+    if args.recover:
+        recover_tone_log(args.recover, args)
+        return
+    if args.batch:
+        return run_batch(args.batch, args)
+
+    if args.fit_csv:
+        t0 = time.perf_counter()
+        modes = fit_modes(load_results_csv(args.fit_csv))
+        print(f"\n  Fit took {(time.perf_counter() - t0) * 1000:.0f} ms")
+        print_modes(modes, args.output)
+        if modes and args.write_header:
+            write_calib_header(modes)
+        return
+
     print("\n" + "=" * 65)
     print("  🔊 BUZZER FREQUENCY ANALYZER")
     print("=" * 65)
@@ -620,30 +4927,66 @@ Examples:
     if device is not None:
         try:
             dev_info = sd.query_devices(device)
-            print(f"  Using device: [{device}] {dev_info['name']}")
+            device_name = dev_info['name']
+            print(f"  Using device: [{device}] {device_name}")
         except Exception as e:
             print(f"\n❌ Invalid device index {device}: {e}")
             return 1
     else:
         default_dev = sd.query_devices(kind='input')
-        print(f"  Using device: {default_dev['name']} (default)")
+        device_name = default_dev['name']
+        print(f"  Using device: {device_name} (default)")
 
-    analyzer = SpectrumAnalyzer()
+    analyzer = SpectrumAnalyzer(track=args.track, spl_offset=args.spl_offset,
+                                denoise=args.denoise, keep_audio=args.onsets)
+    if args.denoise:
+        print(f"  Noise suppression: learning for {NOISE_LEARN_S:.0f} s - keep buzzer silent")
 
-    if args.record:
+    if args.stream:
+        run_stream(args, device=device, source=device_name)
+    elif args.arm:
+        run_armed(args, device=device)
+    elif args.station:
+        station = CalibrationStation(args.station, track=args.track, denoise=args.denoise, publish=True)
+        return run_station(station, units, args, device=device)
+    elif args.drift:
+        drift_live(modes, args.duration, args.output, device=device)
+    elif args.decode_ids:
+        decode_ids_live(args.duration, device=device)
+    elif args.find:
+        find_mode(args.freq, args.mic_spacing / 100, args.duration, device=device)
+    elif args.latency:
+        print(f"\n⏱ LATENCY MODE - ch{args.logic_channel}: BUZ- logic, "
+              f"ch{1 - args.logic_channel}: mic. Trigger beeps, Ctrl+C to finish")
+        audio = capture_raw(args.duration or 60, 2, device=device)
+        print_latency(*measure_latency(audio, SAMPLE_RATE, args.logic_channel,
+                                       args.mic_distance / 100, args.logic_invert))
+    elif args.record:
         # Record and analyze sweep
-        peaks = record_sweep(analyzer, args.duration or 50, device=device)
-        results = analyze_sweep(peaks)
-
-        output_file = args.output
-        if not output_file:
-            timestamp = datetime.now().strftime("%Y%m%d_%H%M%S")
-            output_file = f"buzzer_analysis_{timestamp}.csv"
-
-        print_results(results, output_file)
+        if args.save_rec:
+            analyzer.recorder = RecordingWriter(args.save_rec, recording_metadata(analyzer, device_name, args.sweep,
+                                                                                  args.firmware))
+        # Tones are logged next to the results as they close, so a crash loses nothing
+        args.output = args.output or default_output_file()
+        tone_log_path = Path(args.output).with_suffix('.tones.jsonl')
+        analyzer.tone_log = ToneLog(tone_log_path, {
+            'created': datetime.now().isoformat(timespec='seconds'), 'source': device_name,
+            'firmware': args.firmware or firmware_build(),
+            'sample_rate': analyzer.sample_rate, 'block_size': analyzer.block_size,
+            'sweep': [int(f) for f in args.sweep or sweep_frequencies()]})
+        try:
+            peaks = record_sweep(analyzer, args.duration or 50, device=device)
+        finally:
+            analyzer.tone_log.close()
+            if analyzer.recorder:
+                analyzer.recorder.close()
+        print(f"💾 Tone log: {tone_log_path} ({analyzer.tone_log.count} tones; "
+              f"recover with --recover {tone_log_path})")
+        report_sweep(analyzer, peaks, args)
     else:
         # Live monitoring
-        live_monitor(analyzer, args.duration, device=device)
+        live_monitor(analyzer, args.duration, device=device, beeper=args.beeper,
+                     spectrum_rows=args.spectrum_rows, waterfall_rows=args.waterfall)
 
     return 0
 
@@ -0,0 +1,246 @@
+/*
+ * Native DSP core for buzzer_analyzer.py (--engine native)
+ * =========================================================
+ *
+ * Per-block kernels of SpectrumAnalyzer.process_audio() and the tone
+ * segmentation of detect_tones(), over buffers preallocated by the
+ * caller (no allocation here). Built as a shared library with
+ * "make dsp" and loaded through ctypes (NativeDSP in buzzer_analyzer.py).
+ *
+ * SIMD: the hot loops use GCC/Clang vector extensions on 4 doubles,
+ * which the compiler maps to AVX2, SSE2 pairs or NEON depending on
+ * -march. log10 is a vectorized atanh series on the mantissa (relative
+ * error < 1e-12), so the dB spectrum matches the NumPy reference path
+ * within 2e-13 dB.
+ *
+ * The FFT itself stays in NumPy (pocketfft), which writes into a
+ * preallocated output buffer.
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#define VLEN 4
+
+typedef double v4d __attribute__((vector_size(VLEN * sizeof(double))));
+typedef int64_t v4i __attribute__((vector_size(VLEN * sizeof(int64_t))));
+
+#if defined(__clang__)
+#define SHUFFLE2(a, b, i0, i1, i2, i3) __builtin_shufflevector(a, b, i0, i1, i2, i3)
+#else
+#define SHUFFLE2(a, b, i0, i1, i2, i3) __builtin_shuffle(a, b, (v4i){i0, i1, i2, i3})
+#endif
+
+static inline v4d load4(const double *p) {
+    v4d v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store4(double *p, v4d v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline v4d splat(double x) {
+    return (v4d){x, x, x, x};
+}
+
+/*
+ * Natural log of 4 positive, normal doubles.
+ * x = 2^e * m with m in [sqrt(1/2), sqrt(2)); ln(m) = 2 atanh(s), s = (m-1)/(m+1).
+ */
+static inline v4d log4(v4d x) {
+    const v4i bits = (v4i)x;
+    v4d m = (v4d)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+    // Biased exponent to double without an int64 conversion (no such SIMD op before AVX-512):
+    // splice it into the mantissa of 2^52 and subtract
+    v4d exponent = (v4d)(((bits >> 52) & 0x7ff) | 0x4330000000000000LL) - splat(4503599627370496.0 + 1023);
+
+    // Fold m into [sqrt(1/2), sqrt(2)): halve it and bump the exponent (mask is 0 or -1)
+    const v4i big = (v4i)(m > splat(M_SQRT2));
+    const v4d adjust = (v4d)(big & (v4i)splat(1.0));
+    m = m * (splat(1.0) - splat(0.5) * adjust);
+    exponent += adjust;
+
+    const v4d s = (m - splat(1.0)) / (m + splat(1.0));
+    const v4d s2 = s * s;
+    v4d poly = splat(2.0 / 15);
+    poly = poly * s2 + splat(2.0 / 13);
+    poly = poly * s2 + splat(2.0 / 11);
+    poly = poly * s2 + splat(2.0 / 9);
+    poly = poly * s2 + splat(2.0 / 7);
+    poly = poly * s2 + splat(2.0 / 5);
+    poly = poly * s2 + splat(2.0 / 3);
+    poly = poly * s2 + splat(2.0);
+    return exponent * splat(M_LN2) + s * poly;
+}
+
+/*
+ * Input health and windowing in one pass.
+ * stats[0] = max |x|, stats[1] = sum x, stats[2] = sum x^2, stats[3] = #|x| >= clip_level.
+ */
+void bz_health_window(const double *x, const double *window, double *out, int n,
+                      double clip_level, double *stats) {
+    v4d vmax = splat(0.0), vsum = splat(0.0), vsq = splat(0.0), vclip = splat(0.0);
+    int i = 0;
+    for (; i + VLEN <= n; i += VLEN) {
+        const v4d v = load4(x + i);
+        const v4d a = (v4d)((v4i)v & ~((v4i)splat(-0.0)));  // |v|: clear the sign bit
+        const v4i higher = (v4i)(a > vmax);
+        vmax = (v4d)(((v4i)a & higher) | ((v4i)vmax & ~higher));
+        vsum += v;
+        vsq += v * v;
+        vclip += (v4d)((v4i)(a >= splat(clip_level)) & (v4i)splat(1.0));
+        store4(out + i, v * load4(window + i));
+    }
+    double peak = 0.0, sum = 0.0, sq = 0.0, clipped = 0.0;
+    for (int k = 0; k < VLEN; k++) {
+        peak = vmax[k] > peak ? vmax[k] : peak;
+        sum += vsum[k];
+        sq += vsq[k];
+        clipped += vclip[k];
+    }
+    for (; i < n; i++) {
+        const double a = fabs(x[i]);
+        peak = a > peak ? a : peak;
+        sum += x[i];
+        sq += x[i] * x[i];
+        clipped += a >= clip_level;
+        out[i] = x[i] * window[i];
+    }
+    stats[0] = peak;
+    stats[1] = sum;
+    stats[2] = sq;
+    stats[3] = clipped;
+}
+
+/*
+ * Magnitude of an rfft output (interleaved re, im), scaled by 1/N.
+ */
+void bz_magnitude(const double *fft, double *mag, int n_bins, double scale) {
+    int i = 0;
+    for (; i + VLEN <= n_bins; i += VLEN) {
+        const v4d a = load4(fft + 2 * i);
+        const v4d b = load4(fft + 2 * i + VLEN);
+        // Deinterleave: re = a0 a2 b0 b2, im = a1 a3 b1 b3
+        const v4d re = SHUFFLE2(a, b, 0, 2, 4, 6);
+        const v4d im = SHUFFLE2(a, b, 1, 3, 5, 7);
+        v4d power = re * re + im * im;
+        for (int k = 0; k < VLEN; k++)
+            power[k] = sqrt(power[k]);  // sqrtpd with -fno-math-errno
+        store4(mag + i, power * splat(scale));
+    }
+    for (; i < n_bins; i++)
+        mag[i] = sqrt(fft[2 * i] * fft[2 * i] + fft[2 * i + 1] * fft[2 * i + 1]) * scale;
+}
+
+/*
+ * dB spectrum, 20 log10(mag + ref), plus power (sum of mag^2) of the bands
+ * starting at band_starts[0..n_bands-1] (the last one runs to n_bins).
+ */
+void bz_db_bands(const double *mag, double *mag_db, int n_bins, double ref,
+                 const int64_t *band_starts, int n_bands, double *band_power) {
+    const v4d db_scale = splat(20.0 / M_LN10);
+    int i = 0;
+    for (; i + VLEN <= n_bins; i += VLEN)
+        store4(mag_db + i, db_scale * log4(load4(mag + i) + splat(ref)));
+    for (; i < n_bins; i++)
+        mag_db[i] = 20.0 * log10(mag[i] + ref);
+
+    for (int b = 0; b < n_bands; b++) {
+        const int start = (int)band_starts[b];
+        const int end = b + 1 < n_bands ? (int)band_starts[b + 1] : n_bins;
+        v4d acc = splat(0.0);
+        int j = start;
+        for (; j + VLEN <= end; j += VLEN) {
+            const v4d v = load4(mag + j);
+            acc += v * v;
+        }
+        double power = acc[0] + acc[1] + acc[2] + acc[3];
+        for (; j < end; j++)
+            power += mag[j] * mag[j];
+        band_power[b] = power;
+    }
+}
+
+/*
+ * Harmonic bins of a fundamental, as SpectrumAnalyzer.find_harmonics():
+ * the bin closest to n * fundamental (first one on a tie), if within
+ * tol_hz, then the highest bin within +-int(tol_hz / resolution) of it.
+ * Writes harmonic numbers and bin indices; returns how many were found.
+ */
+int bz_harmonics(const double *spec_db, const double *freqs, int n_bins, double fundamental,
+                 double nyquist, int max_harmonic, double tol_hz, double resolution,
+                 int64_t *out_n, int64_t *out_idx) {
+    int found = 0;
+    const int half = (int)(tol_hz / resolution);
+    for (int n = 1; n <= max_harmonic; n++) {
+        const double target = fundamental * n;
+        if (target > nyquist)
+            break;
+
+        int closest = (int)(target / resolution);
+        if (closest < 0)
+            closest = 0;
+        if (closest > n_bins - 1)
+            closest = n_bins - 1;
+        // Settle on the exact argmin of |freqs - target| around the estimate
+        while (closest > 0 && fabs(freqs[closest - 1] - target) <= fabs(freqs[closest] - target))
+            closest--;
+        while (closest < n_bins - 1 && fabs(freqs[closest + 1] - target) < fabs(freqs[closest] - target))
+            closest++;
+        if (!(fabs(freqs[closest] - target) <= tol_hz))
+            continue;
+
+        const int start = closest - half > 0 ? closest - half : 0;
+        const int end = closest + half + 1 < n_bins ? closest + half + 1 : n_bins;
+        int best = start;
+        for (int j = start + 1; j < end; j++)
+            if (spec_db[j] > spec_db[best])
+                best = j;
+        out_n[found] = n;
+        out_idx[found] = best;
+        found++;
+    }
+    return found;
+}
+
+/*
+ * Tone segmentation, as ToneSegmenter over a whole recording: a tone
+ * opens when db > threshold and closes on the first entry at or below it
+ * (or at the last entry). Tones shorter than min_duration or with fewer
+ * than min_samples entries are dropped. Writes [start, end) entry ranges
+ * (end = closing entry, or n when the recording ends inside the tone);
+ * returns the number of tones.
+ */
+int bz_segment(const double *t, const double *db, int n, double threshold,
+               double min_duration, int min_samples, int64_t *starts, int64_t *ends) {
+    int count = 0;
+    int i = 0;
+    while (i < n) {
+        // Skip quiet entries four at a time
+        const v4d thr = splat(threshold);
+        while (i + VLEN <= n) {
+            const v4i loud = (v4i)(load4(db + i) > thr);
+            if (loud[0] | loud[1] | loud[2] | loud[3])
+                break;
+            i += VLEN;
+        }
+        while (i < n && !(db[i] > threshold))
+            i++;
+        if (i >= n)
+            break;
+
+        const int start = i;
+        while (i < n && db[i] > threshold)
+            i++;
+        const double close_t = i < n ? t[i] : t[i - 1];
+        if (close_t - t[start] >= min_duration && i - start >= min_samples) {
+            starts[count] = start;
+            ends[count] = i;
+            count++;
+        }
+    }
+    return count;
+}
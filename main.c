@@ -15,6 +15,7 @@
  * Operation:
  *   BUZ- LOW  = beep (square wave at calibrated frequency)
  *   BUZ- HIGH = silence
+ *   With a unit ID in EEPROM, beeps hop frequency to identify the unit
  *
  * Calibration (short PB1 to GND at power-on):
  *   1. Two beeps confirm calibration mode
@@ -33,6 +34,11 @@
 #include <avr/wdt.h>
 #include <util/delay.h>
 
+#ifdef USE_CALIB_TABLE
+#include <avr/pgmspace.h>
+#include "calib_modes.h"    // Fitted mode table (buzzer_analyzer.py --fit-modes --write-header)
+#endif
+
 /* ========== F_CPU Validation ========== */
 #if F_CPU != 1200000UL && F_CPU != 9600000UL
     #error "F_CPU must be 1200000 (1.2 MHz with CKDIV8) or 9600000 (9.6 MHz)"
@@ -60,6 +66,7 @@
 #define EEPROM_FREQ_ADDR 0      // Frequency address in EEPROM (2 bytes)
 #define EEPROM_MAGIC_ADDR 2     // Magic byte address
 #define EEPROM_MAGIC    0xAB    // Magic byte for validity check
+#define EEPROM_ID_ADDR  3       // Beacon unit ID (1-6, anything else = plain beeps)
 
 /* ========== Calibration Range ========== */
 /*
@@ -70,6 +77,9 @@
  *   - Finer steps don't help (piezo locks to nearest mode)
  *
  * Total sweep time: 6 steps × 2 sec = ~12 seconds
+ *
+ * With USE_CALIB_TABLE (make USE_CALIB_TABLE=1, needs calib_modes.h)
+ * the sweep visits only the fitted mode centers from that table.
  */
 #define FREQ_MIN        2400    // Minimum sweep frequency (Hz)
 #define FREQ_MAX        3000    // Maximum sweep frequency (Hz) - focused range
@@ -84,6 +94,19 @@
 #define CALIB_TONE_MS   1500    // Calibration tone duration (ms)
 #define CALIB_PAUSE_MS  500     // Pause between calibration tones (ms)
 
+/* ========== Identity Beacon ========== */
+/*
+ * With a unit ID (1-6) in EEPROM, each beep hops between 7 channels
+ * FREQ_STEP apart, advancing ID channels every slot (mod 7):
+ *   ID 2 at 2500 Hz: 2500, 2700, 2900, 2400, 2600, ...
+ * Every hop is the same size for a given unit, so buzzer_analyzer.py
+ * --decode-ids can tell several buzzers apart from one mic.
+ * Program the ID with: make set-id ID=3
+ */
+#define ID_CHANNELS     7       // Hop channels (prime: every ID visits all of them)
+#define ID_SLOT_TICKS   1000    // Main loop ticks per hop (~100 ms)
+#define ID_SPAN         (ID_CHANNELS * FREQ_STEP)
+
 /* ========== Global Variables ========== */
 volatile uint16_t current_freq = DEFAULT_FREQ;
 
@@ -202,6 +225,15 @@ uint16_t load_freq_from_eeprom(void) {
     return freq;
 }
 
+/*
+ * Load beacon unit ID from EEPROM
+ * Returns 0 (no hopping) unless a valid ID 1..ID_CHANNELS-1 is stored
+ */
+uint8_t load_id_from_eeprom(void) {
+    uint8_t id = eeprom_read_byte((uint8_t*)EEPROM_ID_ADDR);
+    return (id < ID_CHANNELS) ? id : 0;
+}
+
 /*
  * Save frequency to EEPROM
  */
@@ -227,7 +259,12 @@ void auto_sweep_mode(void) {
     // Loop forever (user powers off to exit)
     while (1) {
         // Play all frequencies, saving each before playing
+#ifdef USE_CALIB_TABLE
+        for (uint8_t i = 0; i < CALIB_MODE_COUNT; i++) {
+            uint16_t freq = pgm_read_word(&calib_modes[i]);
+#else
         for (uint16_t freq = FREQ_MIN; freq <= FREQ_MAX; freq += FREQ_STEP) {
+#endif
             save_freq_to_eeprom(freq);  // Save BEFORE playing
             current_freq = freq;
             beep(freq, CALIB_TONE_MS);
@@ -286,6 +323,11 @@ int main(void) {
 
     pause(200);
 
+    // Identity beacon: hop step for this unit (0 = plain beeps)
+    uint16_t id_step = load_id_from_eeprom() * FREQ_STEP;
+    uint16_t hop_freq = current_freq;
+    uint16_t slot_ticks = 0;
+
     // Main loop
     uint8_t sound_on = 0;
 
@@ -293,8 +335,19 @@ int main(void) {
         if (fc_wants_sound()) {
             // FC wants sound
             if (!sound_on) {
-                tone_start(current_freq);
+                // Hops start at the calibrated frequency (sweep range if outside it)
+                hop_freq = (current_freq > FREQ_MAX) ? FREQ_MIN : current_freq;
+                slot_ticks = 0;
+                tone_start(hop_freq);
                 sound_on = 1;
+            } else if (id_step && ++slot_ticks >= ID_SLOT_TICKS) {
+                // Next slot: hop ID channels, wrapping within the span
+                slot_ticks = 0;
+                hop_freq += id_step;
+                if (hop_freq >= FREQ_MIN + ID_SPAN) {
+                    hop_freq -= ID_SPAN;
+                }
+                tone_start(hop_freq);
             }
         } else {
             // FC wants silence